@@ -0,0 +1,215 @@
+#include <benchmark/benchmark.h>
+
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+#include "png-decoder/bit_reader.hpp"
+#include "png-decoder/crc_calculator.hpp"
+#include "png-decoder/deflate_wrappers.hpp"
+#include "png-decoder/filters.hpp"
+#include "png-decoder/pixel_unpacker.hpp"
+#include "png-decoder/png_decoder.hpp"
+
+#ifndef TASK_DIR
+#define TASK_DIR "."
+#endif
+
+const std::string kBasePath = TASK_DIR;
+
+const std::vector<std::string> kImages = {
+        "logo.png", "lenna_grayscale.png", "lenna_index.png", "logo_alpha.png",
+        "1.png", "inter.png", "alpha_grayscale.png", "smile_plte.png",
+        "bulletproof.png", "bulletproof_64.png", "bulletproof_mono.png",
+        "white1.png", "my_bw.png", "my1.png", "small1.png"};
+
+std::vector<uint8_t> RandomBytes(std::size_t size) {
+    std::mt19937 rnd(size);
+    std::vector<uint8_t> result(size);
+    for (auto &byte: result) {
+        byte = rnd();
+    }
+    return result;
+}
+
+void SetMegapixelsRate(benchmark::State &state, std::size_t pixels) {
+    state.counters["MP/s"] = benchmark::Counter(static_cast<double>(pixels) * state.iterations() / 1e6,
+                                                benchmark::Counter::kIsRate);
+}
+
+//===========//
+//==FILTERS==//
+//===========//
+
+// args: filter type, bpp. 4096 pixels wide image of 16 rows.
+// Filters are removed in place again and again without restoring the data and without PauseTiming,
+// which would measure the clock for fast filters: the filter type bytes are kept
+// and unfiltering of uniformly random bytes gives uniformly random bytes, so every iteration does the same work
+void BM_RemoveFilter(benchmark::State &state) {
+    const uint8_t filter_type = state.range(0);
+    const std::size_t bpp = state.range(1);
+    const std::size_t row_len = 4096 * bpp;
+    const std::size_t height = 16;
+    std::vector<uint8_t> data = RandomBytes((row_len + 1) * height);
+    for (std::size_t row = 0; row < height; row++) {
+        data[row * (row_len + 1)] = filter_type;
+    }
+
+    for (auto _: state) {
+        remove_filters(data.data(), 8 * bpp, row_len, height);
+        benchmark::DoNotOptimize(data.data());
+    }
+    state.SetBytesProcessed(state.iterations() * row_len * height);
+}
+BENCHMARK(BM_RemoveFilter)->ArgsProduct({{0, 1, 2, 3, 4}, {1, 2, 3, 4, 6, 8}});
+
+//==============//
+//==BIT READER==//
+//==============//
+
+void BM_BitReaderRead(benchmark::State &state) {
+    const int bits_count = state.range(0);
+    const std::size_t count = 1 << 16;
+    const std::vector<uint8_t> data = RandomBytes(count * bits_count / 8);
+    for (auto _: state) {
+        BitReader bit_reader(data.data());
+        uint32_t sum = 0;
+        for (std::size_t i = 0; i < count; i++) {
+            sum += bit_reader.read(bits_count);
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_BitReaderRead)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16);
+
+// args: color type, bit depth
+void BM_ReadPixel(benchmark::State &state) {
+    IHDR ihdr{};
+    ihdr.color_type = state.range(0);
+    ihdr.bit_depth = state.range(1);
+    const std::string palette(3 * 256, '\x7f');
+    const std::size_t width = 1 << 14;
+    const std::vector<uint8_t> data = RandomBytes(ihdr.get_pixel_len_in_bits() * width / 8);
+    for (auto _: state) {
+        BitReader bit_reader(data.data());
+        for (std::size_t i = 0; i < width; i++) {
+            benchmark::DoNotOptimize(read_pixel(ihdr, bit_reader, palette));
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+    SetMegapixelsRate(state, width);
+}
+BENCHMARK(BM_ReadPixel)->Args({0, 1})->Args({0, 8})->Args({2, 8})->Args({2, 16})->Args({3, 8})->Args({6, 8})->Args({6, 16});
+
+// the specialized loops that replace read_pixel in the decoder
+void BM_PixelUnpacker(benchmark::State &state) {
+    IHDR ihdr{};
+    ihdr.color_type = state.range(0);
+    ihdr.bit_depth = state.range(1);
+    const std::string palette(3 * 256, '\x7f');
+    const std::size_t width = 1 << 14;
+    const std::vector<uint8_t> data = RandomBytes(ihdr.get_pixel_len_in_bits() * width / 8);
+    PixelUnpacker unpacker(ihdr, palette);
+    std::vector<RGB> pixels(width);
+    for (auto _: state) {
+        unpacker.unpack(data.data(), width, pixels.data());
+        benchmark::DoNotOptimize(pixels.data());
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+    SetMegapixelsRate(state, width);
+}
+BENCHMARK(BM_PixelUnpacker)->Args({0, 1})->Args({0, 8})->Args({2, 8})->Args({2, 16})->Args({3, 8})->Args({6, 8})->Args({6, 16});
+
+// the same for the 16-bit output formats
+void BM_PixelUnpacker16(benchmark::State &state) {
+    IHDR ihdr{};
+    ihdr.color_type = state.range(0);
+    ihdr.bit_depth = state.range(1);
+    const std::string palette(3 * 256, '\x7f');
+    const std::size_t width = 1 << 14;
+    const std::vector<uint8_t> data = RandomBytes(ihdr.get_pixel_len_in_bits() * width / 8);
+    PixelUnpacker16 unpacker(ihdr, palette);
+    std::vector<RGB16> pixels(width);
+    for (auto _: state) {
+        unpacker.unpack(data.data(), width, pixels.data());
+        benchmark::DoNotOptimize(pixels.data());
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+    SetMegapixelsRate(state, width);
+}
+BENCHMARK(BM_PixelUnpacker16)->Args({0, 8})->Args({0, 16})->Args({2, 16})->Args({3, 8})->Args({6, 8})->Args({6, 16});
+
+//=======//
+//==CRC==//
+//=======//
+
+void BM_Crc(benchmark::State &state) {
+    const std::vector<uint8_t> data = RandomBytes(state.range(0));
+    for (auto _: state) {
+        CrcCalculator crc_calculator;
+        crc_calculator.add_bytes(reinterpret_cast<const char *>(data.data()), data.size());
+        benchmark::DoNotOptimize(crc_calculator.get_checksum());
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_Crc)->Arg(64)->Arg(8 << 10)->Arg(1 << 20);
+
+//===========//
+//==INFLATE==//
+//===========//
+
+// args: compression level. 4 MiB of smooth data, roughly like filtered image rows
+void BM_Inflate(benchmark::State &state) {
+    std::vector<uint8_t> raw(4 << 20);
+    std::mt19937 rnd(1);
+    for (std::size_t i = 0; i < raw.size(); i++) {
+        raw[i] = static_cast<uint8_t>(i / 64 + rnd() % 4);
+    }
+    uLongf compressed_size = compressBound(raw.size());
+    std::string compressed(compressed_size, '\0');
+    compress2(reinterpret_cast<Bytef *>(compressed.data()), &compressed_size, raw.data(), raw.size(), state.range(0));
+    compressed.resize(compressed_size);
+
+    DeflateWrapper deflate_wrapper;
+    ByteBuffer result;
+    for (auto _: state) {
+        deflate_wrapper.deflate(compressed, raw.size(), true, result);
+        benchmark::DoNotOptimize(result.data());
+    }
+    state.SetBytesProcessed(state.iterations() * raw.size());
+}
+BENCHMARK(BM_Inflate)->Arg(1)->Arg(6)->Arg(9);
+
+//============//
+//==READ PNG==//
+//============//
+
+void BM_ReadPng(benchmark::State &state, const std::string &filename) {
+    std::string path = kBasePath + "tests/" + filename;
+    std::ifstream input(path, std::ios_base::in | std::ios_base::binary);
+    std::size_t file_size = std::distance(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+
+    std::size_t pixels = 0;
+    for (auto _: state) {
+        Image image = ReadPng(path);
+        pixels = static_cast<std::size_t>(image.Height()) * image.Width();
+        benchmark::DoNotOptimize(&image(0, 0));
+    }
+    state.SetBytesProcessed(state.iterations() * file_size);
+    SetMegapixelsRate(state, pixels);
+}
+
+int main(int argc, char **argv) {
+    for (const auto &filename: kImages) {
+        benchmark::RegisterBenchmark(("BM_ReadPng/" + filename).c_str(), BM_ReadPng, filename)
+                ->Unit(benchmark::kMillisecond);
+    }
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -1,14 +1,35 @@
 add_library(crc_calculator STATIC png-decoder/crc_calculator.cpp)
+target_link_libraries(crc_calculator ${CMAKE_SOURCE_DIR}/libdeflate/liblibdeflate.a)
+
+find_package(ZLIB REQUIRED)
+find_package(Threads REQUIRED)
 
 add_library(png_decoder OBJECT
         png-decoder/png_decoder.cpp
         png-decoder/ihdr.cpp
         png-decoder/bit_reader.cpp
         png-decoder/deflate_wrappers.cpp
+        png-decoder/chunk_reader.cpp
+        png-decoder/decode_limits.cpp
+        png-decoder/filters.cpp
+        png-decoder/filters_simd.cpp
+        png-decoder/interlace.cpp
+        png-decoder/pixel_unpacker.cpp
+        png-decoder/scanline_reader.cpp
+        png-decoder/mapped_file.cpp
+        png-decoder/thread_pool.cpp
         )
 
 target_link_libraries(png_decoder
         crc_calculator
-        ${CMAKE_SOURCE_DIR}/libdeflate/liblibdeflate.a)
+        ${CMAKE_SOURCE_DIR}/libdeflate/liblibdeflate.a
+        ZLIB::ZLIB
+        Threads::Threads)
+
+# per-stage times and counters of every decoding, see DecodeStats
+option(PNG_DECODER_STATS "Collect DecodeStats in PNGDecoder" OFF)
+if (PNG_DECODER_STATS)
+    target_compile_definitions(png_decoder PUBLIC PNG_DECODER_STATS)
+endif ()
 
 set(PNG_STATIC png_decoder)
@@ -4,7 +4,7 @@ BitReaderException::BitReaderException(const std::string &message)
     : std::runtime_error("BitReaderException: \"" + message + "\"") {
 }
 
-BitReader::BitReader(uint8_t *data_) : data(data_) {
+BitReader::BitReader(const uint8_t *data_) : data(data_) {
 }
 
 uint32_t BitReader::read(int bits_count) {
@@ -9,11 +9,11 @@ struct BitReaderException : std::runtime_error {
 };
 
 class BitReader {
-    uint8_t *data;
+    const uint8_t *data;
     int bits_accum = 7;
 
 public:
-    BitReader(uint8_t *data_);
+    BitReader(const uint8_t *data_);
 
     uint32_t read(int bits_count);
 };
\ No newline at end of file
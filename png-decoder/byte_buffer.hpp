@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+// Grow-only byte buffer for the decompressed data. Unlike std::string it never fills new bytes with zeros,
+// the decompressor overwrites the whole buffer anyway
+class ByteBuffer {
+    std::unique_ptr<char[]> buffer;
+    std::size_t buffer_size = 0;
+    std::size_t buffer_capacity = 0;
+
+public:
+    // the contents are undefined after growing
+    void resize(std::size_t size) {
+        if (size > buffer_capacity) {
+            buffer.reset(new char[size]);
+            buffer_capacity = size;
+        }
+        buffer_size = size;
+    }
+
+    char *data() {
+        return buffer.get();
+    }
+
+    const char *data() const {
+        return buffer.get();
+    }
+
+    std::size_t size() const {
+        return buffer_size;
+    }
+
+    std::size_t capacity() const {
+        return buffer_capacity;
+    }
+};
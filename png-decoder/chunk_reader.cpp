@@ -0,0 +1,219 @@
+#include "chunk_reader.hpp"
+#include "crc_calculator.hpp"
+#include "png_decoder.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+const uint8_t PNG_SIGNATURE[] = {137, 80, 78, 71, 13, 10, 26, 10};
+
+std::string get_read_context_name(read_context_t type) {
+    if (type == read_context_t::PNG_SIGNATURE) {
+        return "png signature";
+    } else if (type == read_context_t::CHUNK_DATA_LENGTH) {
+        return "chunk data length";
+    } else if (type == read_context_t::CHUNK_TYPE_CODE) {
+        return "chunk type code";
+    } else if (type == read_context_t::CHUNK_DATA) {
+        return "chunk data";
+    } else {
+        return "chunk CRC";
+    }
+}
+
+// throws if less than byte_count bytes are left in the input
+void check_bytes_left(const MemoryInput &input, std::size_t byte_count, read_context_t type) {
+    if (input.size - input.offset < byte_count) {
+        throw FailedToReadException("\"" + get_read_context_name(type) + "\"\ncaught message: unexpected end of data");
+    }
+}
+
+void read_bytes(std::istream &input, void *buffer, std::size_t byte_count, read_context_t type, bool need_to_reverse_bytes) {
+    char *buffer_char = reinterpret_cast<char *>(buffer);
+    std::string context = get_read_context_name(type);
+
+    try {
+        input.read(buffer_char, byte_count);
+    } catch (std::exception &error) {
+        throw FailedToReadException("\"" + context + "\"\ncaught message: " + error.what());
+    }
+    // the stream may have no exceptions set, e.g. when it is passed by the user
+    if (static_cast<std::size_t>(input.gcount()) != byte_count) {
+        throw FailedToReadException("\"" + context + "\"\ncaught message: unexpected end of stream");
+    }
+    if (need_to_reverse_bytes) {
+        std::reverse(buffer_char, buffer_char + byte_count);
+    }
+}
+
+void read_bytes(MemoryInput &input, void *buffer, std::size_t byte_count, read_context_t type, bool need_to_reverse_bytes) {
+    check_bytes_left(input, byte_count, type);
+    char *buffer_char = reinterpret_cast<char *>(buffer);
+    std::memcpy(buffer_char, input.data + input.offset, byte_count);
+    input.offset += byte_count;
+    if (need_to_reverse_bytes) {
+        std::reverse(buffer_char, buffer_char + byte_count);
+    }
+}
+
+void check_signature(const char *signature) {
+    if (std::memcmp(PNG_SIGNATURE, signature, 8) != 0) {
+        std::string actual_values;
+        for (std::size_t byte = 0; byte < 8; byte++) {
+            actual_values += std::to_string(static_cast<uint8_t>(signature[byte]));
+            if (byte != 7) {
+                actual_values += ' ';
+            }
+        }
+        throw InvalidPNGFormatException("invalid signature: " + actual_values);
+    }
+}
+
+void read_signature(std::istream &input) {
+    char signature[8];
+    read_bytes(input, signature, 8, read_context_t::PNG_SIGNATURE, false);
+    check_signature(signature);
+}
+
+void read_signature(MemoryInput &input) {
+    char signature[8];
+    read_bytes(input, signature, 8, read_context_t::PNG_SIGNATURE, false);
+    check_signature(signature);
+}
+
+template<typename Input>
+ChunkHeader read_chunk_header_impl(Input &input) {
+    ChunkHeader header;
+    read_bytes(input, &header.data_length, 4, read_context_t::CHUNK_DATA_LENGTH, true);
+
+    if (header.data_length > (static_cast<uint32_t>(1) << 31)) {
+        throw InvalidPNGFormatException("invalid chunk data length: " + std::to_string(header.data_length) + ", more than 2^31");
+    }
+
+    read_bytes(input, header.type_code, 4, read_context_t::CHUNK_TYPE_CODE, false);
+    return header;
+}
+
+ChunkHeader read_chunk_header(std::istream &input) {
+    return read_chunk_header_impl(input);
+}
+
+ChunkHeader read_chunk_header(MemoryInput &input) {
+    return read_chunk_header_impl(input);
+}
+
+void check_chunk_data_length(const ChunkHeader &header, std::size_t max_data_length) {
+    if (header.data_length > max_data_length) {
+        throw InvalidPNGFormatException("invalid chunk \"" + std::string(header.type_code, 4) + "\" data length: " +
+                                        std::to_string(header.data_length) + ", more than " +
+                                        std::to_string(max_data_length));
+    }
+}
+
+bool is_ancillary_chunk(const ChunkHeader &header) {
+    // ancillary bit is bit 5 of the first byte: lowercase letter
+    return (header.type_code[0] & 0x20) != 0;
+}
+
+#ifdef PNG_DECODER_STATS
+thread_local std::uint64_t chunk_crc_ns = 0;
+#endif
+
+// part of the chunk data read through a stream
+void add_crc_bytes(CrcCalculator &crc_calculator, const char *data, std::size_t size) {
+#ifdef PNG_DECODER_STATS
+    auto start = std::chrono::steady_clock::now();
+#endif
+    crc_calculator.add_bytes(data, size);
+#ifdef PNG_DECODER_STATS
+    chunk_crc_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+#endif
+}
+
+// CRC of the type code and the data of the whole chunk in memory
+void check_chunk_data_crc(const ChunkHeader &header, const char *data, uint32_t actual_crc) {
+#ifdef PNG_DECODER_STATS
+    auto start = std::chrono::steady_clock::now();
+#endif
+    CrcCalculator crc_calculator;
+    crc_calculator.add_bytes(header.type_code, 4);
+    crc_calculator.add_bytes(data, header.data_length);
+    uint32_t correct_crc = crc_calculator.get_checksum();
+#ifdef PNG_DECODER_STATS
+    chunk_crc_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+#endif
+    check_chunk_crc(actual_crc, correct_crc);
+}
+
+void read_chunk_data(std::istream &input, ChunkHeader &header, char *data, bool need_to_check_crc) {
+    read_bytes(input, data, header.data_length, read_context_t::CHUNK_DATA, false);
+
+    uint32_t actual_crc;
+    read_bytes(input, &actual_crc, 4, read_context_t::CHUNK_CRC, true);
+    if (need_to_check_crc) {
+        check_chunk_data_crc(header, data, actual_crc);
+    }
+}
+
+void append_chunk_data(std::istream &input, ChunkHeader &header, std::string &data, bool need_to_check_crc) {
+    const std::size_t MAX_PART_SIZE = 1 << 16;
+    std::size_t offset = data.size();
+    uint32_t data_left = header.data_length;
+    while (data_left > 0) {
+        std::size_t part = std::min<std::size_t>(data_left, MAX_PART_SIZE);
+        data.resize(data.size() + part);
+        read_bytes(input, data.data() + data.size() - part, part, read_context_t::CHUNK_DATA, false);
+        data_left -= part;
+    }
+
+    uint32_t actual_crc;
+    read_bytes(input, &actual_crc, 4, read_context_t::CHUNK_CRC, true);
+    if (need_to_check_crc) {
+        check_chunk_data_crc(header, data.data() + offset, actual_crc);
+    }
+}
+
+const char *read_chunk_data(MemoryInput &input, ChunkHeader &header, bool need_to_check_crc) {
+    check_bytes_left(input, header.data_length, read_context_t::CHUNK_DATA);
+    const char *data = reinterpret_cast<const char *>(input.data + input.offset);
+    input.offset += header.data_length;
+
+    uint32_t actual_crc;
+    read_bytes(input, &actual_crc, 4, read_context_t::CHUNK_CRC, true);
+    if (need_to_check_crc) {
+        check_chunk_data_crc(header, data, actual_crc);
+    }
+    return data;
+}
+
+void skip_chunk_data(std::istream &input, ChunkHeader &header, bool need_to_check_crc) {
+    char buffer[1 << 12];
+    CrcCalculator crc_calculator;
+    crc_calculator.add_bytes(header.type_code, 4);
+    uint32_t data_left = header.data_length;
+    while (data_left > 0) {
+        std::size_t part = std::min<std::size_t>(data_left, sizeof(buffer));
+        read_bytes(input, buffer, part, read_context_t::CHUNK_DATA, false);
+        if (need_to_check_crc) {
+            add_crc_bytes(crc_calculator, buffer, part);
+        }
+        data_left -= part;
+    }
+
+    uint32_t actual_crc;
+    read_bytes(input, &actual_crc, 4, read_context_t::CHUNK_CRC, true);
+    if (need_to_check_crc) {
+        check_chunk_crc(actual_crc, crc_calculator.get_checksum());
+    }
+}
+
+void skip_chunk_data(MemoryInput &input, ChunkHeader &header, bool need_to_check_crc) {
+    read_chunk_data(input, header, need_to_check_crc);
+}
+
+void check_chunk_crc(uint32_t actual_crc, uint32_t correct_crc) {
+    if (actual_crc != correct_crc) {
+        throw InvalidPNGFormatException("\ninvalid CRC: actual = " + std::to_string(actual_crc) +
+                                        ", correct = " + std::to_string(correct_crc));
+    }
+}
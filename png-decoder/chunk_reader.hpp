@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+
+enum class read_context_t {
+    PNG_SIGNATURE,
+    CHUNK_DATA_LENGTH,
+    CHUNK_TYPE_CODE,
+    CHUNK_DATA,
+    CHUNK_CRC
+};
+
+struct ChunkHeader {
+    uint32_t data_length;
+    char type_code[4];
+};
+
+// whole PNG file in memory, chunks are parsed in place
+struct MemoryInput {
+    const uint8_t *data;
+    std::size_t size;
+    std::size_t offset = 0;
+};
+
+void read_bytes(std::istream &input, void *buffer, std::size_t byte_count, read_context_t type, bool need_to_reverse_bytes);
+
+void read_bytes(MemoryInput &input, void *buffer, std::size_t byte_count, read_context_t type, bool need_to_reverse_bytes);
+
+void read_signature(std::istream &input);
+
+void read_signature(MemoryInput &input);
+
+ChunkHeader read_chunk_header(std::istream &input);
+
+ChunkHeader read_chunk_header(MemoryInput &input);
+
+// data lengths of the chunks the decoders keep in memory, longer ones are invalid
+const std::size_t IHDR_DATA_LENGTH = 13;
+const std::size_t MAX_PLTE_DATA_LENGTH = 3 * 256;
+const std::size_t MAX_TRNS_DATA_LENGTH = 256;
+const std::size_t ACTL_DATA_LENGTH = 8;
+
+// throws if the chunk data is longer than max_data_length, before it is read
+void check_chunk_data_length(const ChunkHeader &header, std::size_t max_data_length);
+
+// chunks that are not needed to display the image, e.g. tEXt, gAMA
+bool is_ancillary_chunk(const ChunkHeader &header);
+
+#ifdef PNG_DECODER_STATS
+// time spent on CRC of the chunk data read by this thread, for DecodeStats::crc_ns
+extern thread_local std::uint64_t chunk_crc_ns;
+#endif
+
+// reads chunk data straight into data[0, header.data_length) and validates CRC
+void read_chunk_data(std::istream &input, ChunkHeader &header, char *data, bool need_to_check_crc);
+
+// validates CRC and returns the chunk data in place, without copying
+const char *read_chunk_data(MemoryInput &input, ChunkHeader &header, bool need_to_check_crc);
+
+// appends chunk data to data and validates CRC, data grows in parts of at most 64 KiB as they are read,
+// so a false data length at the end of the stream doesn't allocate it
+void append_chunk_data(std::istream &input, ChunkHeader &header, std::string &data, bool need_to_check_crc);
+
+// reads chunk data through a small fixed buffer and validates CRC, nothing is kept
+void skip_chunk_data(std::istream &input, ChunkHeader &header, bool need_to_check_crc);
+
+void skip_chunk_data(MemoryInput &input, ChunkHeader &header, bool need_to_check_crc);
+
+// throws if actual_crc read from the stream != correct_crc
+void check_chunk_crc(uint32_t actual_crc, uint32_t correct_crc);
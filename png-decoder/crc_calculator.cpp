@@ -1,16 +1,16 @@
 #include "crc_calculator.hpp"
-#include "boost/crc.hpp"
+#include "../libdeflate/libdeflate.h"
 
-namespace crc_calculator {
-    boost::crc_32_type crc_accumulate;
+// libdeflate picks the PCLMULQDQ/ARMv8 CRC implementation at runtime,
+// with slicing-by-8 as the fallback
+void CrcCalculator::add_bytes(const char *buffer, std::size_t byte_count) {
+    crc_accumulate = libdeflate_crc32(crc_accumulate, buffer, byte_count);
+}
 
-    void add_bytes(char *buffer, std::size_t byte_count) {
-        crc_accumulate.process_bytes(buffer, byte_count);
-    }
-    void reset() {
-        crc_accumulate.reset();
-    }
-    uint32_t get_checksum() {
-        return crc_accumulate.checksum();
-    }
-}// namespace crc_calculator
\ No newline at end of file
+void CrcCalculator::reset() {
+    crc_accumulate = 0;
+}
+
+uint32_t CrcCalculator::get_checksum() const {
+    return crc_accumulate;
+}
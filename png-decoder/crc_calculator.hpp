@@ -1,9 +1,17 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
+
+// CRC-32 accumulator of the PNG chunks. A value object without shared state,
+// so every chunk (and every decoder) has its own and decodes can run concurrently
+class CrcCalculator {
+    uint32_t crc_accumulate = 0;
+
+public:
+    void add_bytes(const char *buffer, std::size_t byte_count);
 
-namespace crc_calculator {
-    void add_bytes(char *buffer, std::size_t byte_count);
     void reset();
-    uint32_t get_checksum();
-};// namespace crc_calculator
+
+    uint32_t get_checksum() const;
+};
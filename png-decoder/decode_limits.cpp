@@ -0,0 +1,33 @@
+#include "decode_limits.hpp"
+#include "interlace.hpp"
+#include <chrono>
+#include <string>
+
+void check_limit(std::uint64_t value, std::uint64_t limit, const char *name) {
+    if (limit != 0 && value > limit) {
+        throw DecodeLimitException(std::string(name) + " = " + std::to_string(value) + ", more than " +
+                                   std::to_string(limit));
+    }
+}
+
+void check_deadline(const DecodeLimits &limits) {
+    if (std::chrono::steady_clock::now() > limits.deadline) {
+        throw DecodeLimitException("deadline");
+    }
+}
+
+void check_image_limits(IHDR ihdr, const DecodeLimits &limits) {
+    check_limit(static_cast<std::uint64_t>(ihdr.width) * ihdr.height, limits.max_pixels, "pixels");
+    check_limit(get_pixels_data_size(ihdr), limits.max_decompressed_bytes, "decompressed bytes");
+}
+
+void check_chunk_limits(const ChunkHeader &chunk, const DecodeLimits &limits,
+                        std::size_t &chunk_count, std::size_t &ancillary_bytes) {
+    check_limit(++chunk_count, limits.max_chunk_count, "chunk count");
+    check_limit(chunk.data_length, limits.max_chunk_size, "chunk size");
+    if (is_ancillary_chunk(chunk)) {
+        ancillary_bytes += chunk.data_length;
+        check_limit(ancillary_bytes, limits.max_ancillary_bytes, "ancillary bytes");
+    }
+    check_deadline(limits);
+}
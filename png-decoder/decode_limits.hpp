@@ -0,0 +1,20 @@
+#pragma once
+
+#include "chunk_reader.hpp"
+#include "ihdr.hpp"
+#include "png_decoder.hpp"
+#include <cstddef>
+#include <cstdint>
+
+// throws DecodeLimitException if value > limit, 0 means no limit
+void check_limit(std::uint64_t value, std::uint64_t limit, const char *name);
+
+void check_deadline(const DecodeLimits &limits);
+
+// before the buffers for the image are allocated
+void check_image_limits(IHDR ihdr, const DecodeLimits &limits);
+
+// right after the chunk header is read, before the chunk data is allocated and read,
+// chunk_count and ancillary_bytes are the totals of the chunks read so far
+void check_chunk_limits(const ChunkHeader &chunk, const DecodeLimits &limits,
+                        std::size_t &chunk_count, std::size_t &ancillary_bytes);
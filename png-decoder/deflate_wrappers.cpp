@@ -15,13 +15,7 @@ DeflateWrapper::~DeflateWrapper() {
     libdeflate_free_decompressor(decompressor);
 }
 
-std::string DeflateWrapper::deflate(std::string data) {
-    std::string result(1000 * data.size(), '\0');
-    size_t actual_out_nbytes_ret = 0;
-    libdeflate_result result_code = libdeflate_zlib_decompress(
-            decompressor, data.data(), data.size(), result.data(), result.size(),
-            &actual_out_nbytes_ret);
-
+void check_decompress_result(libdeflate_result result_code, std::size_t decompressed_size) {
     if (result_code == LIBDEFLATE_SUCCESS) {
         // ok
     } else if (result_code == LIBDEFLATE_BAD_DATA) {
@@ -29,11 +23,89 @@ std::string DeflateWrapper::deflate(std::string data) {
                 "decompress bad data, see LIBDEFLATE_BAD_DATA");
     } else if (result_code == LIBDEFLATE_SHORT_OUTPUT) {
         throw DeflateWrapperException(
-                "decompress short output, see LIBDEFLATE_SHORT_OUTPUT");
+                "decompressed data is shorter than expected " + std::to_string(decompressed_size) +
+                " bytes, see LIBDEFLATE_SHORT_OUTPUT");
     } else if (result_code == LIBDEFLATE_INSUFFICIENT_SPACE) {
         throw DeflateWrapperException(
-                "decompress insufficient space, see LIBDEFLATE_INSUFFICIENT_SPACE");
+                "decompressed data is longer than expected " + std::to_string(decompressed_size) +
+                " bytes, see LIBDEFLATE_INSUFFICIENT_SPACE");
+    }
+}
+
+void DeflateWrapper::deflate(std::string_view data, std::size_t decompressed_size, bool need_to_check_adler32,
+                             ByteBuffer &result) {
+    // a deflate stream expands at most 1032 times, e.g. a few hundred bytes of IDAT can't be gigabytes of pixels
+    const std::size_t MAX_EXPANSION = 1032;
+    const std::size_t MAX_EXPANSION_SLACK = 1 << 10;
+    if (decompressed_size > data.size() * MAX_EXPANSION + MAX_EXPANSION_SLACK) {
+        throw DeflateWrapperException("compressed data of " + std::to_string(data.size()) +
+                                      " bytes can't be decompressed to " + std::to_string(decompressed_size) +
+                                      " bytes");
+    }
+    result.resize(decompressed_size);
+    if (need_to_check_adler32) {
+        // actual_out_nbytes_ret = nullptr: the stream must fill the buffer exactly
+        libdeflate_result result_code = libdeflate_zlib_decompress(
+                decompressor, data.data(), data.size(), result.data(), result.size(),
+                nullptr);
+        check_decompress_result(result_code, decompressed_size);
+        return;
+    }
+
+    // zlib stream is 2 bytes header, raw deflate stream and 4 bytes Adler-32,
+    // the header is checked like libdeflate_zlib_decompress does, the trailer is only required to be present
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data.data());
+    if (data.size() < 2 + 4 || (bytes[0] & 0x0f) != 8 || (bytes[0] >> 4) > 7 ||
+        (bytes[0] * 256 + bytes[1]) % 31 != 0 || (bytes[1] & 0x20) != 0) {
+        throw DeflateWrapperException(
+                "decompress bad data, see LIBDEFLATE_BAD_DATA");
     }
-    result.resize(actual_out_nbytes_ret);
-    return result;
+    std::size_t actual_in_size;
+    libdeflate_result result_code = libdeflate_deflate_decompress_ex(
+            decompressor, data.data() + 2, data.size() - 2, result.data(), result.size(),
+            &actual_in_size, nullptr);
+    check_decompress_result(result_code, decompressed_size);
+    if (data.size() - 2 - actual_in_size < 4) {
+        throw DeflateWrapperException(
+                "decompress bad data, see LIBDEFLATE_BAD_DATA");
+    }
+}
+
+InflateStreamWrapper::InflateStreamWrapper() {
+    if (inflateInit(&stream) != Z_OK) {
+        throw DeflateWrapperException("bad init inflate stream");
+    }
+}
+
+InflateStreamWrapper::~InflateStreamWrapper() {
+    inflateEnd(&stream);
+}
+
+void InflateStreamWrapper::set_input(const char *data, std::size_t size) {
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    stream.avail_in = static_cast<uInt>(size);
+}
+
+bool InflateStreamWrapper::need_input() const {
+    return stream.avail_in == 0;
+}
+
+std::size_t InflateStreamWrapper::inflate(char *out, std::size_t size) {
+    stream.next_out = reinterpret_cast<Bytef *>(out);
+    stream.avail_out = static_cast<uInt>(size);
+
+    int result_code = ::inflate(&stream, Z_NO_FLUSH);
+    if (result_code == Z_STREAM_END) {
+        is_stream_end = true;
+    } else if (result_code == Z_BUF_ERROR) {
+        // no progress is possible, need more input
+    } else if (result_code != Z_OK) {
+        throw DeflateWrapperException("inflate bad data, zlib code = " + std::to_string(result_code) +
+                                      (stream.msg != nullptr ? ", " + std::string(stream.msg) : ""));
+    }
+    return size - stream.avail_out;
+}
+
+bool InflateStreamWrapper::is_finished() const {
+    return is_stream_end;
 }
@@ -1,8 +1,11 @@
 #pragma once
 
 #include "../libdeflate/libdeflate.h"
+#include "byte_buffer.hpp"
+#include <zlib.h>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 
 struct DeflateWrapperException : std::runtime_error {
     explicit DeflateWrapperException(const std::string &message);
@@ -24,5 +27,40 @@ public:
 
     DeflateWrapper &operator=(DeflateWrapper &&other) = delete;
 
-    std::string deflate(std::string data);
-};
\ No newline at end of file
+    // decompressed_size is the exact size of the zlib stream content,
+    // Adler-32 of the content is not verified if !need_to_check_adler32.
+    // result is resized to decompressed_size, its capacity is reused.
+    // Throws before allocating if data is too short to expand to decompressed_size
+    void deflate(std::string_view data, std::size_t decompressed_size, bool need_to_check_adler32, ByteBuffer &result);
+};
+
+// RAII wrapper over a zlib inflate stream, used when the compressed data
+// arrives in parts and must not be accumulated in memory
+class InflateStreamWrapper {
+    z_stream stream{};
+    bool is_stream_end = false;
+
+public:
+    InflateStreamWrapper();
+
+    ~InflateStreamWrapper();
+
+    InflateStreamWrapper(const InflateStreamWrapper &other) = delete;
+
+    InflateStreamWrapper(InflateStreamWrapper &&other) = delete;
+
+    InflateStreamWrapper &operator=(const InflateStreamWrapper &other) = delete;
+
+    InflateStreamWrapper &operator=(InflateStreamWrapper &&other) = delete;
+
+    // data must stay alive until need_input() returns true
+    void set_input(const char *data, std::size_t size);
+
+    bool need_input() const;
+
+    // returns the number of bytes written to out, at most size
+    std::size_t inflate(char *out, std::size_t size);
+
+    // the end of zlib stream is reached and its Adler-32 is verified
+    bool is_finished() const;
+};
@@ -0,0 +1,160 @@
+#include "filters.hpp"
+#include "filters_simd.hpp"
+#include "png_decoder.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cstdlib>
+
+void remove_sub_filter(uint8_t *data, std::size_t byte_count, std::size_t bpp) {
+#ifdef PNG_DECODER_SSE2
+    filters_simd::remove_sub_filter_sse2(data, byte_count, bpp);
+#else
+    // the first pixel has no left neighbour and stays unchanged
+    for (std::size_t byte = bpp; byte < byte_count; byte++) {
+        data[byte] += data[byte - bpp];
+    }
+#endif
+}
+
+void remove_up_filter(uint8_t *data, const uint8_t *up, std::size_t byte_count) {
+    if (up == nullptr) {
+        return;
+    }
+    for (std::size_t byte = 0; byte < byte_count; byte++) {
+        data[byte] += up[byte];
+    }
+}
+
+void remove_average_filter(uint8_t *data, const uint8_t *up, std::size_t byte_count, std::size_t bpp) {
+    if (up == nullptr) {
+        // the first row: top = 0, the first pixel stays unchanged
+        for (std::size_t byte = bpp; byte < byte_count; byte++) {
+            data[byte] += data[byte - bpp] >> 1;
+        }
+        return;
+    }
+
+#ifdef PNG_DECODER_SSE2
+    if (bpp >= 3) {
+        filters_simd::remove_average_filter_sse2(data, up, byte_count, bpp);
+        return;
+    }
+#endif
+
+    // the first pixel: left = 0
+    std::size_t first_pixel_bytes = std::min(bpp, byte_count);
+    for (std::size_t byte = 0; byte < first_pixel_bytes; byte++) {
+        data[byte] += up[byte] >> 1;
+    }
+    for (std::size_t byte = bpp; byte < byte_count; byte++) {
+        data[byte] += (up[byte] + data[byte - bpp]) >> 1;
+    }
+}
+
+void remove_paeth_filter(uint8_t *data, const uint8_t *up, std::size_t byte_count, std::size_t bpp) {
+    if (up == nullptr) {
+        // PaethPredictor(left, 0, 0) = left
+        remove_sub_filter(data, byte_count, bpp);
+        return;
+    }
+
+#ifdef PNG_DECODER_X86_SIMD
+    if ((bpp == 3 || bpp == 4) && filters_simd::has_sse41()) {
+        filters_simd::remove_paeth_filter_sse41(data, up, byte_count, bpp);
+        return;
+    }
+#endif
+
+    // PaethPredictor(0, top, 0) = top
+    std::size_t first_pixel_bytes = std::min(bpp, byte_count);
+    for (std::size_t byte = 0; byte < first_pixel_bytes; byte++) {
+        data[byte] += up[byte];
+    }
+    // branch-free PaethPredictor: the compiler turns both selects into cmov
+    for (std::size_t byte = bpp; byte < byte_count; byte++) {
+        int left = data[byte - bpp];
+        int top = up[byte];
+        int top_left = up[byte - bpp];
+        int pa = std::abs(top - top_left);
+        int pb = std::abs(left - top_left);
+        int pc = std::abs(left + top - 2 * top_left);
+        int predictor = pb <= pc ? top : top_left;
+        predictor = (pa <= pb && pa <= pc) ? left : predictor;
+        data[byte] += predictor;
+    }
+}
+
+void remove_filter(uint8_t *scanline, const uint8_t *previous_scanline, std::size_t row_len_in_bytes, std::size_t bpp) {
+    const uint8_t *up = previous_scanline == nullptr ? nullptr : previous_scanline + 1;
+    if (*scanline == 0) {
+        // нет фильтров
+    } else if (*scanline == 1) {
+        remove_sub_filter(scanline + 1, row_len_in_bytes, bpp);
+    } else if (*scanline == 2) {
+        remove_up_filter(scanline + 1, up, row_len_in_bytes);
+    } else if (*scanline == 3) {
+        remove_average_filter(scanline + 1, up, row_len_in_bytes, bpp);
+    } else if (*scanline == 4) {
+        remove_paeth_filter(scanline + 1, up, row_len_in_bytes, bpp);
+    } else {
+        throw InvalidPNGFormatException("invalid row filter mode = " + std::to_string(*scanline) + ", != 0-4");
+    }
+}
+
+void remove_filters(uint8_t *data, std::size_t pixel_len_in_bits, std::size_t row_len_in_bytes, std::size_t height) {
+    std::size_t bpp = (pixel_len_in_bits + 7) / 8;
+
+    const uint8_t *previous_scanline = nullptr;
+    for (std::size_t row = 0; row < height; row++, data += row_len_in_bytes + 1) {
+        remove_filter(data, previous_scanline, row_len_in_bytes, bpp);
+        previous_scanline = data;
+    }
+}
+
+void count_filter_types(const uint8_t *data, std::size_t row_len_in_bytes, std::size_t height,
+                        std::array<std::size_t, 5> &counts) {
+    std::size_t scanline_len = row_len_in_bytes + 1;
+    for (std::size_t row = 0; row < height; row++) {
+        uint8_t filter_type = data[row * scanline_len];
+        if (filter_type < counts.size()) {
+            counts[filter_type]++;
+        }
+    }
+}
+
+std::vector<std::size_t> split_into_independent_segments(const uint8_t *data, std::size_t row_len_in_bytes,
+                                                         std::size_t height, std::size_t min_task_bytes) {
+    std::size_t scanline_len = row_len_in_bytes + 1;
+    std::vector<std::size_t> task_starts = {0};
+    std::size_t task_bytes = 0;
+    for (std::size_t row = 0; row < height; row++) {
+        if (task_bytes >= min_task_bytes && data[row * scanline_len] <= 1) {
+            task_starts.push_back(row);
+            task_bytes = 0;
+        }
+        task_bytes += scanline_len;
+    }
+    return task_starts;
+}
+
+void remove_filters_parallel(uint8_t *data, std::size_t pixel_len_in_bits, std::size_t row_len_in_bytes,
+                             std::size_t height, ThreadPool &pool) {
+    // a few tasks per thread, so the threads stay busy when segments differ in cost
+    const std::size_t MIN_TASK_BYTES = 1 << 16;
+    std::size_t scanline_len = row_len_in_bytes + 1;
+    std::size_t task_bytes = std::max(MIN_TASK_BYTES, scanline_len * height / (4 * pool.get_thread_count()));
+
+    std::vector<std::size_t> task_starts = split_into_independent_segments(data, row_len_in_bytes, height, task_bytes);
+    if (task_starts.size() == 1) {
+        remove_filters(data, pixel_len_in_bits, row_len_in_bytes, height);
+        return;
+    }
+    task_starts.push_back(height);
+
+    pool.parallel_for(task_starts.size() - 1, [&](std::size_t task) {
+        std::size_t start = task_starts[task];
+        // the first row of the segment is None or Sub (or the first row of the image),
+        // it doesn't read the previous row, which may be unfiltered by another task right now
+        remove_filters(data + start * scanline_len, pixel_len_in_bits, row_len_in_bytes, task_starts[task + 1] - start);
+    });
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+// data is a filtered row without the filter type byte,
+// up is the previous unfiltered row of the same (sub)image or nullptr for the first row
+
+void remove_sub_filter(uint8_t *data, std::size_t byte_count, std::size_t bpp);
+
+void remove_up_filter(uint8_t *data, const uint8_t *up, std::size_t byte_count);
+
+void remove_average_filter(uint8_t *data, const uint8_t *up, std::size_t byte_count, std::size_t bpp);
+
+void remove_paeth_filter(uint8_t *data, const uint8_t *up, std::size_t byte_count, std::size_t bpp);
+
+// scanline is the filter type byte followed by row_len_in_bytes bytes,
+// previous_scanline is the previous unfiltered scanline or nullptr for the first row
+void remove_filter(uint8_t *scanline, const uint8_t *previous_scanline, std::size_t row_len_in_bytes, std::size_t bpp);
+
+// data is height scanlines stored one after another
+void remove_filters(uint8_t *data, std::size_t pixel_len_in_bits, std::size_t row_len_in_bytes, std::size_t height);
+
+// adds the number of rows of every filter type to counts, rows of invalid types are not counted
+void count_filter_types(const uint8_t *data, std::size_t row_len_in_bytes, std::size_t height,
+                        std::array<std::size_t, 5> &counts);
+
+// None and Sub rows don't depend on the previous row, so the image splits into segments starting at them.
+// Returns the first rows of the segments to unfilter as separate tasks, each of at least min_task_bytes
+// (the last one may be smaller), starting with 0
+std::vector<std::size_t> split_into_independent_segments(const uint8_t *data, std::size_t row_len_in_bytes,
+                                                         std::size_t height, std::size_t min_task_bytes);
+
+// remove_filters with the independent segments unfiltered on the pool
+void remove_filters_parallel(uint8_t *data, std::size_t pixel_len_in_bits, std::size_t row_len_in_bytes,
+                             std::size_t height, ThreadPool &pool);
@@ -0,0 +1,261 @@
+#include "filters_simd.hpp"
+
+#ifdef PNG_DECODER_X86_SIMD
+
+#include <algorithm>
+#include <cstring>
+#include <immintrin.h>
+
+namespace filters_simd {
+    bool has_sse41() {
+        static const bool result = __builtin_cpu_supports("sse4.1");
+        return result;
+    }
+
+    // load_bytes bytes are widened to 16-bit lanes
+    template <std::size_t load_bytes>
+    __attribute__((target("sse4.1"))) inline __m128i load_pixel(const uint8_t *data) {
+        uint32_t val = 0;
+        std::memcpy(&val, data, load_bytes);
+        return _mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(val)), _mm_setzero_si128());
+    }
+
+    template <std::size_t store_bytes>
+    __attribute__((target("sse4.1"))) inline void store_pixel(uint8_t *data, __m128i pixel) {
+        uint32_t val = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(pixel, pixel)));
+        std::memcpy(data, &val, store_bytes);
+    }
+
+    __attribute__((target("sse4.1"))) inline __m128i paeth_predictor(__m128i a, __m128i b, __m128i c) {
+        // p = a + b - c, pa = |p - a| = |b - c|, pb = |p - b| = |a - c|, pc = |p - c|
+        __m128i pa_signed = _mm_sub_epi16(b, c);
+        __m128i pb_signed = _mm_sub_epi16(a, c);
+        __m128i pa = _mm_abs_epi16(pa_signed);
+        __m128i pb = _mm_abs_epi16(pb_signed);
+        __m128i pc = _mm_abs_epi16(_mm_add_epi16(pa_signed, pb_signed));
+
+        __m128i smallest = _mm_min_epi16(pa, _mm_min_epi16(pb, pc));
+        __m128i predictor = _mm_blendv_epi8(c, b, _mm_cmpeq_epi16(pb, smallest));
+        return _mm_blendv_epi8(predictor, a, _mm_cmpeq_epi16(pa, smallest));
+    }
+
+    template <std::size_t bpp>
+    __attribute__((target("sse4.1"))) void remove_paeth_filter_sse41_impl(uint8_t *data, const uint8_t *up, std::size_t byte_count) {
+        const __m128i byte_mask = _mm_set1_epi16(0xff);
+        // for bpp = 3 the 4th lane holds the first byte of the next pixel, it must stay unchanged
+        const __m128i pixel_mask = bpp == 3 ? _mm_set_epi16(0, 0, 0, 0, 0, -1, -1, -1) : _mm_set1_epi16(-1);
+        __m128i a = _mm_setzero_si128();// left
+        __m128i c = _mm_setzero_si128();// top left
+        std::size_t byte = 0;
+        // whole 4-byte loads and stores while they fit into the row,
+        // the next pixel is loaded before the current one is stored:
+        // for bpp = 3 the load would overlap the store and wait for it
+        if (byte_count >= 4) {
+            __m128i x = load_pixel<4>(data);
+            while (true) {
+                bool has_next = byte + bpp + 4 <= byte_count;
+                __m128i next_x = has_next ? load_pixel<4>(data + byte + bpp) : x;
+                __m128i b = load_pixel<4>(up + byte);
+                __m128i predictor = _mm_and_si128(paeth_predictor(a, b, c), pixel_mask);
+                a = _mm_and_si128(_mm_add_epi16(x, predictor), byte_mask);
+                c = b;
+                store_pixel<4>(data + byte, a);
+                byte += bpp;
+                if (!has_next) {
+                    break;
+                }
+                x = next_x;
+            }
+        }
+        for (; byte < byte_count; byte += bpp) {
+            __m128i b = load_pixel<bpp>(up + byte);
+            __m128i x = load_pixel<bpp>(data + byte);
+            a = _mm_and_si128(_mm_add_epi16(x, paeth_predictor(a, b, c)), byte_mask);
+            c = b;
+            store_pixel<bpp>(data + byte, a);
+        }
+    }
+
+    void remove_paeth_filter_sse41(uint8_t *data, const uint8_t *up, std::size_t byte_count, std::size_t bpp) {
+        if (bpp == 3) {
+            remove_paeth_filter_sse41_impl<3>(data, up, byte_count);
+        } else {
+            remove_paeth_filter_sse41_impl<4>(data, up, byte_count);
+        }
+    }
+
+#ifdef PNG_DECODER_SSE2
+    inline __m128i load_4_bytes(const uint8_t *data) {
+        uint32_t val;
+        std::memcpy(&val, data, 4);
+        return _mm_cvtsi32_si128(static_cast<int>(val));
+    }
+
+    inline void store_4_bytes(uint8_t *data, __m128i x) {
+        uint32_t val = static_cast<uint32_t>(_mm_cvtsi128_si32(x));
+        std::memcpy(data, &val, 4);
+    }
+
+    template <std::size_t bytes>
+    inline __m128i load_bytes(const uint8_t *data) {
+        if constexpr (bytes == 16) {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+        } else if constexpr (bytes == 12) {
+            __m128i low = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(data));
+            return _mm_unpacklo_epi64(low, load_4_bytes(data + 8));
+        } else if constexpr (bytes == 8) {
+            return _mm_loadl_epi64(reinterpret_cast<const __m128i *>(data));
+        } else if constexpr (bytes == 4) {
+            return load_4_bytes(data);
+        } else {
+            uint64_t val = 0;
+            std::memcpy(&val, data, bytes);
+            return _mm_set_epi64x(0, static_cast<long long>(val));
+        }
+    }
+
+    template <std::size_t bytes>
+    inline void store_bytes(uint8_t *data, __m128i x) {
+        if constexpr (bytes == 16) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(data), x);
+        } else if constexpr (bytes == 12) {
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(data), x);
+            store_4_bytes(data + 8, _mm_unpackhi_epi64(x, x));
+        } else if constexpr (bytes == 8) {
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(data), x);
+        } else if constexpr (bytes == 4) {
+            store_4_bytes(data, x);
+        } else {
+            alignas(16) uint8_t buffer[16];
+            _mm_store_si128(reinterpret_cast<__m128i *>(buffer), x);
+            std::memcpy(data, buffer, bytes);
+        }
+    }
+
+    // Sub filter is a prefix sum over pixels, a block holds a whole number of pixels:
+    // 16 bytes for bpp = 1, 2, 4, 8 and 12 bytes for bpp = 3, 6
+    template <std::size_t bpp, std::size_t block>
+    inline __m128i prefix_sum(__m128i x) {
+        x = _mm_add_epi8(x, _mm_slli_si128(x, bpp));
+        if constexpr (2 * bpp < block) {
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 2 * bpp));
+        }
+        if constexpr (4 * bpp < block) {
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 4 * bpp));
+        }
+        if constexpr (8 * bpp < block) {
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 8 * bpp));
+        }
+        return x;
+    }
+
+    // the last pixel of the block repeated over the whole block
+    template <std::size_t bpp>
+    inline __m128i broadcast_last_pixel(__m128i x) {
+        if constexpr (bpp == 1) {
+            x = _mm_unpackhi_epi8(x, x);
+            x = _mm_shufflehi_epi16(x, 0xff);
+            return _mm_shuffle_epi32(x, 0xff);
+        } else if constexpr (bpp == 2) {
+            x = _mm_shufflehi_epi16(x, 0xff);
+            return _mm_shuffle_epi32(x, 0xff);
+        } else if constexpr (bpp == 4) {
+            return _mm_shuffle_epi32(x, 0xff);
+        } else if constexpr (bpp == 8) {
+            return _mm_unpackhi_epi64(x, x);
+        } else if constexpr (bpp == 3) {
+            x = _mm_srli_si128(_mm_slli_si128(x, 4), 13);// bytes 9-11 moved to 0-2
+            x = _mm_or_si128(x, _mm_slli_si128(x, 3));
+            return _mm_or_si128(x, _mm_slli_si128(x, 6));
+        } else {
+            x = _mm_srli_si128(_mm_slli_si128(x, 4), 10);// bytes 6-11 moved to 0-5
+            return _mm_or_si128(x, _mm_slli_si128(x, 6));
+        }
+    }
+
+    template <std::size_t bpp>
+    void remove_sub_filter_sse2_impl(uint8_t *data, std::size_t byte_count) {
+        constexpr std::size_t block = (bpp == 3 || bpp == 6) ? 12 : 16;
+        __m128i carry = _mm_setzero_si128();
+        std::size_t byte = 0;
+        for (; byte + block <= byte_count; byte += block) {
+            __m128i x = load_bytes<block>(data + byte);
+            x = _mm_add_epi8(prefix_sum<bpp, block>(x), carry);
+            store_bytes<block>(data + byte, x);
+            carry = broadcast_last_pixel<bpp>(x);
+        }
+        for (byte = std::max(byte, bpp); byte < byte_count; byte++) {
+            data[byte] += data[byte - bpp];
+        }
+    }
+
+    void remove_sub_filter_sse2(uint8_t *data, std::size_t byte_count, std::size_t bpp) {
+        switch (bpp) {
+            case 1:
+                return remove_sub_filter_sse2_impl<1>(data, byte_count);
+            case 2:
+                return remove_sub_filter_sse2_impl<2>(data, byte_count);
+            case 3:
+                return remove_sub_filter_sse2_impl<3>(data, byte_count);
+            case 4:
+                return remove_sub_filter_sse2_impl<4>(data, byte_count);
+            case 6:
+                return remove_sub_filter_sse2_impl<6>(data, byte_count);
+            default:
+                return remove_sub_filter_sse2_impl<8>(data, byte_count);
+        }
+    }
+
+    // (a + b) / 2 per byte, _mm_avg_epu8 rounds up
+    inline __m128i floor_average(__m128i a, __m128i b) {
+        __m128i round_bit = _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1));
+        return _mm_sub_epi8(_mm_avg_epu8(a, b), round_bit);
+    }
+
+    // the left pixel stays in a register, bytes of one pixel are handled together
+    template <std::size_t bpp>
+    void remove_average_filter_sse2_impl(uint8_t *data, const uint8_t *up, std::size_t byte_count) {
+        constexpr std::size_t load_len = bpp <= 4 ? 4 : 8;
+        // bytes past the pixel belong to the next one and must stay unchanged
+        const __m128i pixel_mask = _mm_srli_si128(_mm_set1_epi8(-1), 16 - bpp);
+        __m128i a = _mm_setzero_si128();
+        std::size_t byte = 0;
+        // the next pixel is loaded before the current one is stored, see remove_paeth_filter_sse41_impl
+        if (byte_count >= load_len) {
+            __m128i x = load_bytes<load_len>(data);
+            while (true) {
+                bool has_next = byte + bpp + load_len <= byte_count;
+                __m128i next_x = has_next ? load_bytes<load_len>(data + byte + bpp) : x;
+                __m128i average = _mm_and_si128(floor_average(a, load_bytes<load_len>(up + byte)), pixel_mask);
+                a = _mm_add_epi8(x, average);
+                store_bytes<load_len>(data + byte, a);
+                byte += bpp;
+                if (!has_next) {
+                    break;
+                }
+                x = next_x;
+            }
+        }
+        for (; byte < byte_count; byte += bpp) {
+            __m128i x = load_bytes<bpp>(data + byte);
+            a = _mm_add_epi8(x, floor_average(a, load_bytes<bpp>(up + byte)));
+            store_bytes<bpp>(data + byte, a);
+        }
+    }
+
+    void remove_average_filter_sse2(uint8_t *data, const uint8_t *up, std::size_t byte_count, std::size_t bpp) {
+        switch (bpp) {
+            case 3:
+                return remove_average_filter_sse2_impl<3>(data, up, byte_count);
+            case 4:
+                return remove_average_filter_sse2_impl<4>(data, up, byte_count);
+            case 6:
+                return remove_average_filter_sse2_impl<6>(data, up, byte_count);
+            default:
+                return remove_average_filter_sse2_impl<8>(data, up, byte_count);
+        }
+    }
+#endif
+}// namespace filters_simd
+
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define PNG_DECODER_X86_SIMD
+// SSE2 is a part of x86-64, so it needs no runtime check
+#ifdef __SSE2__
+#define PNG_DECODER_SSE2
+#endif
+#endif
+
+#ifdef PNG_DECODER_X86_SIMD
+
+namespace filters_simd {
+    // checked once at runtime by cpuid
+    bool has_sse41();
+
+    // bpp must be 3 or 4, up != nullptr
+    void remove_paeth_filter_sse41(uint8_t *data, const uint8_t *up, std::size_t byte_count, std::size_t bpp);
+
+#ifdef PNG_DECODER_SSE2
+    // bpp must be 1, 2, 3, 4, 6 or 8
+    void remove_sub_filter_sse2(uint8_t *data, std::size_t byte_count, std::size_t bpp);
+
+    // bpp must be 3, 4, 6 or 8, up != nullptr
+    void remove_average_filter_sse2(uint8_t *data, const uint8_t *up, std::size_t byte_count, std::size_t bpp);
+#endif
+}// namespace filters_simd
+
+#endif
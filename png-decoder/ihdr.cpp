@@ -1,11 +1,12 @@
 #include "ihdr.hpp"
+#include <algorithm>
 #include <cstring>
 
 IHDRException::IHDRException(const std::string &message)
     : std::runtime_error("IHDRException: \"" + message + "\"") {
 }
 
-void IHDR::read(std::string data) {
+void IHDR::read(std::string_view data) {
     if (data.size() != sizeof(IHDR)) {
         throw IHDRException("bad read data");
     }
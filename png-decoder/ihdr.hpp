@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 
 struct IHDRException : std::runtime_error {
     explicit IHDRException(const std::string &message);
@@ -19,7 +20,7 @@ struct IHDR {
     uint8_t filter_method;
     uint8_t interlace_method;
 
-    void read(std::string data);
+    void read(std::string_view data);
 
     std::size_t get_pixel_len_in_bits();
 };
@@ -1,39 +1,50 @@
 #pragma once
 
+#include <cstdint>
 #include <iostream>
 #include <vector>
 
-struct RGB {
-    int r = 0, g = 0, b = 0, a = 0;
-    bool operator==(const RGB &rhs) const {
+// one pixel of 8-bit (RGB) or 16-bit (RGB16) RGBA, channels are packed without padding
+template <typename T>
+struct BasicRGB {
+    T r = 0, g = 0, b = 0, a = 0;
+    bool operator==(const BasicRGB &rhs) const {
         return r == rhs.r && g == rhs.g && b == rhs.b && a == rhs.a;
     }
 };
 
-inline std::ostream &operator<<(std::ostream &out, const RGB &x) {
-    out << x.r << " " << x.g << " " << x.b << " " << x.a;
+using RGB = BasicRGB<uint8_t>;
+using RGB16 = BasicRGB<uint16_t>;
+
+static_assert(sizeof(RGB) == 4);
+static_assert(sizeof(RGB16) == 8);
+
+template <typename T>
+inline std::ostream &operator<<(std::ostream &out, const BasicRGB<T> &x) {
+    out << static_cast<int>(x.r) << " " << static_cast<int>(x.g) << " " << static_cast<int>(x.b) << " " << static_cast<int>(x.a);
     return out;
 }
 
-class Image {
+template <typename Pixel>
+class BasicImage {
 public:
-    Image() {}
-    Image(int height, int width) {
+    BasicImage() {}
+    BasicImage(int height, int width) {
         SetSize(height, width);
     }
 
     void SetSize(int height, int width) {
         height_ = height;
         width_ = width;
-        data_.resize(height_ * width_);
+        data_.resize(static_cast<std::size_t>(height_) * width_);
     }
 
-    const RGB &operator()(int row, int col) const {
-        return data_[width_ * row + col];
+    const Pixel &operator()(int row, int col) const {
+        return data_[static_cast<std::size_t>(width_) * row + col];
     }
 
-    RGB &operator()(int row, int col) {
-        return data_[width_ * row + col];
+    Pixel &operator()(int row, int col) {
+        return data_[static_cast<std::size_t>(width_) * row + col];
     }
 
     int Height() const {
@@ -45,7 +56,12 @@ public:
     }
 
 private:
-    std::vector<RGB> data_;
+    std::vector<Pixel> data_;
     int height_ = 0;
     int width_ = 0;
 };
+
+// 8 bits per channel, 4 bytes per pixel
+using Image = BasicImage<RGB>;
+// 16 bits per channel, for 16-bit sources that need full precision
+using Image16 = BasicImage<RGB16>;
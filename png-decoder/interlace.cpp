@@ -0,0 +1,66 @@
+#include "interlace.hpp"
+#include "png_decoder.hpp"
+#include <limits>
+
+const InterlacePass INTERLACE_PASSES[8] = {
+        {0, 0, 0, 1, 1},
+        {1, 0, 0, 8, 8},
+        {2, 0, 4, 8, 8},
+        {3, 4, 0, 8, 4},
+        {4, 0, 2, 4, 4},
+        {5, 2, 0, 4, 2},
+        {6, 0, 1, 2, 2},
+        {7, 1, 0, 2, 1},
+};
+
+std::pair<std::size_t, std::size_t> get_subimage_shape_in_interlace(int pass_cnt, std::size_t image_height, std::size_t image_width) {
+    switch (pass_cnt) {
+        case 0:
+            return {image_height, image_width};
+        case 1:
+            return {(image_height + 7) / 8, (image_width + 7) / 8};
+        case 2:
+            return {(image_height + 7) / 8, (image_width - 4 + 7) / 8};
+        case 3:
+            return {(image_height - 4 + 7) / 8, (image_width + 3) / 4};
+        case 4:
+            return {(image_height + 3) / 4, (image_width - 2 + 3) / 4};
+        case 5:
+            return {(image_height - 2 + 3) / 4, (image_width + 1) / 2};
+        case 6:
+            return {(image_height + 1) / 2, (image_width - 1 + 1) / 2};
+        case 7:
+            return {(image_height - 1 + 1) / 2, image_width};
+    }
+    throw PNGDecoderException("call get_subimage_shape_in_interlace(), invalid pass_cnt = " +
+                              std::to_string(pass_cnt) + ", != 0-7");
+}
+
+std::size_t get_subimage_data_size(IHDR ihdr, int pass_cnt) {
+    auto [height, width] = get_subimage_shape_in_interlace(pass_cnt, ihdr.height, ihdr.width);
+    if (height == 0 || width == 0) {
+        return 0;// empty pass is not stored at all
+    }
+    std::size_t row_len_in_bytes = (ihdr.get_pixel_len_in_bits() * width + 7) / 8;
+    if (row_len_in_bytes + 1 > std::numeric_limits<std::size_t>::max() / height) {
+        throw InvalidPNGFormatException("image is too large: width = " + std::to_string(ihdr.width) +
+                                        ", height = " + std::to_string(ihdr.height));
+    }
+    return (row_len_in_bytes + 1) * height;
+}
+
+std::size_t get_pixels_data_size(IHDR ihdr) {
+    if (ihdr.interlace_method == 0) {
+        return get_subimage_data_size(ihdr, 0);
+    }
+    std::size_t result = 0;
+    for (int pass_cnt = 1; pass_cnt <= 7; pass_cnt++) {
+        std::size_t subimage_size = get_subimage_data_size(ihdr, pass_cnt);
+        if (result > std::numeric_limits<std::size_t>::max() - subimage_size) {
+            throw InvalidPNGFormatException("image is too large: width = " + std::to_string(ihdr.width) +
+                                            ", height = " + std::to_string(ihdr.height));
+        }
+        result += subimage_size;
+    }
+    return result;
+}
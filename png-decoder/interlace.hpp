@@ -0,0 +1,25 @@
+#pragma once
+
+#include "ihdr.hpp"
+#include <cstddef>
+#include <utility>
+
+struct InterlacePass {
+    int pass_cnt;
+    std::size_t start_row;
+    std::size_t start_column;
+    std::size_t step_row;
+    std::size_t step_column;
+};
+
+// INTERLACE_PASSES[0] is the whole non-interlaced image, INTERLACE_PASSES[1-7] are Adam7 passes
+extern const InterlacePass INTERLACE_PASSES[8];
+
+// return (height, width)
+std::pair<std::size_t, std::size_t> get_subimage_shape_in_interlace(int pass_cnt, std::size_t image_height, std::size_t image_width);
+
+// size of filtered subimage data, each row starts with a filter type byte
+std::size_t get_subimage_data_size(IHDR ihdr, int pass_cnt);
+
+// exact size of decompressed IDAT data
+std::size_t get_pixels_data_size(IHDR ihdr);
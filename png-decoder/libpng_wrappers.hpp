@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdio>
+#include <cstring>
 #include <png.h>
 
 #include "image.hpp"
@@ -37,7 +38,11 @@ namespace libpng {
         int height_;
     };
 
-    inline Image ReadImage(std::string_view filename) {
+    // Reads any color_type into RGBA format with 8 bits per channel (RGB) or 16 bits per channel (RGB16),
+    // for RGB16 lower bit depths are expanded to 16 bits
+    template <typename Pixel = RGB>
+    inline BasicImage<Pixel> ReadImage(std::string_view filename) {
+        constexpr bool is_16_bit = sizeof(Pixel) == sizeof(RGB16);
         FILE *fp = fopen(filename.data(), "rb");
         png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
         if (!png) {
@@ -59,10 +64,9 @@ namespace libpng {
         png_byte color_type = png_get_color_type(png, info);
         png_byte bit_depth = png_get_bit_depth(png, info);
 
-        // Read any color_type into 8bit depth, RGBA format.
         // See http://www.libpng.org/pub/png/libpng-manual.txt
 
-        if (bit_depth == 16) {
+        if (!is_16_bit && bit_depth == 16) {
             png_set_strip_16(png);
         }
 
@@ -79,16 +83,26 @@ namespace libpng {
             png_set_tRNS_to_alpha(png);
         }
 
+        if (is_16_bit) {
+            png_set_expand_16(png);
+        }
+
         // These color_type don't have an alpha channel then fill it with 0xff.
         if (color_type == PNG_COLOR_TYPE_RGB || color_type == PNG_COLOR_TYPE_GRAY ||
             color_type == PNG_COLOR_TYPE_PALETTE) {
-            png_set_filler(png, 0xFF, PNG_FILLER_AFTER);
+            png_set_filler(png, is_16_bit ? 0xFFFF : 0xFF, PNG_FILLER_AFTER);
         }
 
         if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
             png_set_gray_to_rgb(png);
         }
 
+        // PNG samples are big-endian, RGB16 is in the native byte order
+        uint16_t byte_order_probe = 1;
+        if (is_16_bit && *reinterpret_cast<uint8_t *>(&byte_order_probe) == 1) {
+            png_set_swap(png);
+        }
+
         png_read_update_info(png, info);
 
         StorageWrapper storage(height, png_get_rowbytes(png, info));
@@ -96,12 +110,10 @@ namespace libpng {
         png_destroy_read_struct(&png, &info, nullptr);
         fclose(fp);
 
-        Image result(height, width);
+        // Pixel is 4 packed channels, so rows are copied as is
+        BasicImage<Pixel> result(height, width);
         for (int i = 0; i < height; ++i) {
-            for (int j = 0; j < width; ++j) {
-                auto data = storage.GetPixel(i, j);
-                result(i, j) = RGB{data[0], data[1], data[2], data[3]};
-            }
+            std::memcpy(&result(i, 0), storage.GetStorage()[i], sizeof(Pixel) * width);
         }
         return result;
     }
@@ -139,14 +151,7 @@ namespace libpng {
 
         StorageWrapper storage(image.Height(), image.Width() * 4);
         for (int i = 0; i < image.Height(); ++i) {
-            for (int j = 0; j < image.Width(); ++j) {
-                auto data = storage.GetPixel(i, j);
-                const auto &p = image(i, j);
-                data[0] = p.r;
-                data[1] = p.g;
-                data[2] = p.b;
-                data[3] = p.a;
-            }
+            std::memcpy(storage.GetPixel(i, 0), &image(i, 0), sizeof(RGB) * image.Width());
         }
 
         png_write_image(png, storage.GetStorage());
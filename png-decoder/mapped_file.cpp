@@ -0,0 +1,71 @@
+#include "mapped_file.hpp"
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PNG_DECODER_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef PNG_DECODER_MMAP
+// reads exactly size bytes, returns false on error or unexpected end of file
+bool read_whole(int fd, uint8_t *out, std::size_t size) {
+    while (size != 0) {
+        ssize_t count = read(fd, out, size);
+        if (count <= 0) {
+            return false;
+        }
+        out += count;
+        size -= count;
+    }
+    return true;
+}
+#endif
+
+MappedFile::MappedFile(std::string_view filename) {
+#ifdef PNG_DECODER_MMAP
+    int fd = open(std::string(filename).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+        std::size_t file_size = static_cast<std::size_t>(file_stat.st_size);
+        if (file_size < MIN_MAPPED_FILE_SIZE) {
+            buffer.resize(file_size);
+            if (read_whole(fd, buffer.data(), file_size)) {
+                data = buffer.data();
+                size = file_size;
+            }
+        } else {
+            void *mapped = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                data = static_cast<const uint8_t *>(mapped);
+                size = file_size;
+                is_mmapped = true;
+            }
+        }
+    }
+    // the mapping stays valid after closing
+    close(fd);
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef PNG_DECODER_MMAP
+    if (is_mmapped) {
+        munmap(const_cast<uint8_t *>(data), size);
+    }
+#endif
+}
+
+bool MappedFile::is_mapped() const {
+    return data != nullptr;
+}
+
+std::span<const uint8_t> MappedFile::get_data() const {
+    return {data, size};
+}
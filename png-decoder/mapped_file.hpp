@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// RAII read-only memory mapping of a whole file.
+// Files smaller than MIN_MAPPED_FILE_SIZE are read into a buffer instead: mmap and munmap cost more than the copy
+class MappedFile {
+    const uint8_t *data = nullptr;
+    std::size_t size = 0;
+    bool is_mmapped = false;
+    std::vector<uint8_t> buffer;
+
+public:
+    static constexpr std::size_t MIN_MAPPED_FILE_SIZE = 128 * 1024;
+
+    // stays unmapped if the file can't be mapped: it can't be opened, is not a regular file (pipe, device),
+    // is empty or mmap is unavailable on the platform
+    explicit MappedFile(std::string_view filename);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile &other) = delete;
+
+    MappedFile(MappedFile &&other) = delete;
+
+    MappedFile &operator=(const MappedFile &other) = delete;
+
+    MappedFile &operator=(MappedFile &&other) = delete;
+
+    // the file content is available through get_data()
+    bool is_mapped() const;
+
+    std::span<const uint8_t> get_data() const;
+};
@@ -0,0 +1,233 @@
+#include "pixel_unpacker.hpp"
+#include "png_decoder.hpp"
+
+int cast_to_8_bits(int val, int bit_depth) {
+    return val * 0xff / ((1 << bit_depth) - 1);
+}
+
+// exact without a divide: 0xffff is divisible by 2^bit_depth - 1 for bit depths 1, 2, 4 and 8
+int cast_to_16_bits(int val, int bit_depth) {
+    return val * (0xffff / ((1 << bit_depth) - 1));
+}
+
+// how samples are rescaled to the channels of Pixel
+template <typename Pixel>
+struct PixelScale;
+
+template <>
+struct PixelScale<RGB> {
+    using Channel = uint8_t;
+    static constexpr Channel MAX = 0xff;
+
+    // bit depth 1, 2, 4 or 8
+    static Channel from_bits(int val, int bit_depth) {
+        return cast_to_8_bits(val, bit_depth);
+    }
+
+    static Channel from_8_bits(uint8_t val) {
+        return val;
+    }
+
+    static Channel from_16_bits(uint8_t high, uint8_t low) {
+        // (256 * high + low) * 255 / 65535 = (257 * high + low - high) / 257
+        return high - (low < high);
+    }
+};
+
+template <>
+struct PixelScale<RGB16> {
+    using Channel = uint16_t;
+    static constexpr Channel MAX = 0xffff;
+
+    static Channel from_bits(int val, int bit_depth) {
+        return cast_to_16_bits(val, bit_depth);
+    }
+
+    static Channel from_8_bits(uint8_t val) {
+        return val * 257;
+    }
+
+    static Channel from_16_bits(uint8_t high, uint8_t low) {
+        // big-endian, compiles to a byte swap
+        return static_cast<uint16_t>((high << 8) | low);
+    }
+};
+
+template <typename Pixel>
+Pixel read_pixel(IHDR ihdr, BitReader &bit_reader, std::string_view palette) {
+    using Scale = PixelScale<Pixel>;
+    auto read_sample = [&]() {
+        if (ihdr.bit_depth == 16) {
+            int val = bit_reader.read(16);
+            return Scale::from_16_bits(val >> 8, val & 0xff);
+        }
+        return Scale::from_bits(bit_reader.read(ihdr.bit_depth), ihdr.bit_depth);
+    };
+
+    Pixel result;
+    result.a = Scale::MAX;
+
+    if (ihdr.color_type == 0) {
+        result.r = result.g = result.b = read_sample();
+    } else if (ihdr.color_type == 2) {
+        result.r = read_sample();
+        result.g = read_sample();
+        result.b = read_sample();
+    } else if (ihdr.color_type == 3) {
+        std::size_t color_index = bit_reader.read(ihdr.bit_depth);
+        color_index *= 3;
+        if (color_index + 2 >= palette.size()) {
+            throw InvalidPNGFormatException("pixel index more than palette size");
+        }
+        result.r = Scale::from_8_bits(palette[color_index]);
+        result.g = Scale::from_8_bits(palette[color_index + 1]);
+        result.b = Scale::from_8_bits(palette[color_index + 2]);
+    } else if (ihdr.color_type == 4) {
+        result.r = result.g = result.b = read_sample();
+        result.a = read_sample();
+    } else if (ihdr.color_type == 6) {
+        result.r = read_sample();
+        result.g = read_sample();
+        result.b = read_sample();
+        result.a = read_sample();
+    } else {
+        throw PNGDecoderException("call read_pixel(), invalid ihdr.color_type = " +
+                                  std::to_string(ihdr.color_type) + ", != 0, 2, 3, 4 or 6");
+    }
+    return result;
+}
+
+template <typename Pixel>
+BasicPixelUnpacker<Pixel>::BasicPixelUnpacker(IHDR ihdr_, std::string_view palette_) : ihdr(ihdr_), palette(palette_) {
+    using Scale = PixelScale<Pixel>;
+    for (std::size_t index = 0; index + 2 < palette.size() && palette_colors_size < palette_colors.size(); index += 3) {
+        palette_colors[palette_colors_size++] = {Scale::from_8_bits(palette[index]), Scale::from_8_bits(palette[index + 1]),
+                                                 Scale::from_8_bits(palette[index + 2]), Scale::MAX};
+    }
+
+    unpack_row = &BasicPixelUnpacker::unpack_bit_reader;
+    if (ihdr.color_type == 0) {
+        if (ihdr.bit_depth == 1) {
+            unpack_row = &BasicPixelUnpacker::unpack_packed_gray<1>;
+        } else if (ihdr.bit_depth == 2) {
+            unpack_row = &BasicPixelUnpacker::unpack_packed_gray<2>;
+        } else if (ihdr.bit_depth == 4) {
+            unpack_row = &BasicPixelUnpacker::unpack_packed_gray<4>;
+        } else if (ihdr.bit_depth == 8) {
+            unpack_row = &BasicPixelUnpacker::unpack_samples<1, 8>;
+        } else if (ihdr.bit_depth == 16) {
+            unpack_row = &BasicPixelUnpacker::unpack_samples<1, 16>;
+        }
+    } else if (ihdr.color_type == 2) {
+        if (ihdr.bit_depth == 8) {
+            unpack_row = &BasicPixelUnpacker::unpack_samples<3, 8>;
+        } else if (ihdr.bit_depth == 16) {
+            unpack_row = &BasicPixelUnpacker::unpack_samples<3, 16>;
+        }
+    } else if (ihdr.color_type == 3) {
+        if (ihdr.bit_depth == 1) {
+            unpack_row = &BasicPixelUnpacker::unpack_palette<1>;
+        } else if (ihdr.bit_depth == 2) {
+            unpack_row = &BasicPixelUnpacker::unpack_palette<2>;
+        } else if (ihdr.bit_depth == 4) {
+            unpack_row = &BasicPixelUnpacker::unpack_palette<4>;
+        } else if (ihdr.bit_depth == 8) {
+            unpack_row = &BasicPixelUnpacker::unpack_palette<8>;
+        }
+    } else if (ihdr.color_type == 4) {
+        if (ihdr.bit_depth == 8) {
+            unpack_row = &BasicPixelUnpacker::unpack_samples<2, 8>;
+        } else if (ihdr.bit_depth == 16) {
+            unpack_row = &BasicPixelUnpacker::unpack_samples<2, 16>;
+        }
+    } else if (ihdr.color_type == 6) {
+        if (ihdr.bit_depth == 8) {
+            unpack_row = &BasicPixelUnpacker::unpack_samples<4, 8>;
+        } else if (ihdr.bit_depth == 16) {
+            unpack_row = &BasicPixelUnpacker::unpack_samples<4, 16>;
+        }
+    }
+}
+
+// sample rescaled to the channel size of Pixel
+template <typename Pixel, int bit_depth>
+inline typename PixelScale<Pixel>::Channel read_sample(const uint8_t *data, int index) {
+    if constexpr (bit_depth == 8) {
+        return PixelScale<Pixel>::from_8_bits(data[index]);
+    } else {
+        return PixelScale<Pixel>::from_16_bits(data[2 * index], data[2 * index + 1]);
+    }
+}
+
+// byte-aligned samples: gray, gray + alpha, RGB, RGBA with bit depth 8 or 16
+template <typename Pixel>
+template <int channels, int bit_depth>
+void BasicPixelUnpacker<Pixel>::unpack_samples(const uint8_t *data, std::size_t width, Pixel *out) const {
+    constexpr auto max = PixelScale<Pixel>::MAX;
+    constexpr int pixel_len_in_bytes = channels * bit_depth / 8;
+    for (std::size_t column = 0; column < width; column++, data += pixel_len_in_bytes) {
+        if constexpr (channels == 1) {
+            auto value = read_sample<Pixel, bit_depth>(data, 0);
+            out[column] = {value, value, value, max};
+        } else if constexpr (channels == 2) {
+            auto value = read_sample<Pixel, bit_depth>(data, 0);
+            out[column] = {value, value, value, read_sample<Pixel, bit_depth>(data, 1)};
+        } else if constexpr (channels == 3) {
+            out[column] = {read_sample<Pixel, bit_depth>(data, 0), read_sample<Pixel, bit_depth>(data, 1),
+                           read_sample<Pixel, bit_depth>(data, 2), max};
+        } else {
+            out[column] = {read_sample<Pixel, bit_depth>(data, 0), read_sample<Pixel, bit_depth>(data, 1),
+                           read_sample<Pixel, bit_depth>(data, 2), read_sample<Pixel, bit_depth>(data, 3)};
+        }
+    }
+}
+
+// several gray samples in one byte, the leftmost pixel in the high bits
+template <typename Pixel>
+template <int bit_depth>
+void BasicPixelUnpacker<Pixel>::unpack_packed_gray(const uint8_t *data, std::size_t width, Pixel *out) const {
+    using Channel = typename PixelScale<Pixel>::Channel;
+    constexpr Channel max = PixelScale<Pixel>::MAX;
+    constexpr int max_value = (1 << bit_depth) - 1;
+    constexpr int scale = max / max_value;
+    constexpr std::size_t pixels_per_byte = 8 / bit_depth;
+    for (std::size_t column = 0; column < width; column++) {
+        int shift = 8 - bit_depth - static_cast<int>(column % pixels_per_byte) * bit_depth;
+        Channel value = ((data[column / pixels_per_byte] >> shift) & max_value) * scale;
+        out[column] = {value, value, value, max};
+    }
+}
+
+template <typename Pixel>
+template <int bit_depth>
+void BasicPixelUnpacker<Pixel>::unpack_palette(const uint8_t *data, std::size_t width, Pixel *out) const {
+    constexpr int max_index = (1 << bit_depth) - 1;
+    constexpr std::size_t pixels_per_byte = 8 / bit_depth;
+    for (std::size_t column = 0; column < width; column++) {
+        int shift = 8 - bit_depth - static_cast<int>(column % pixels_per_byte) * bit_depth;
+        std::size_t color_index = (data[column / pixels_per_byte] >> shift) & max_index;
+        if (color_index >= palette_colors_size) {
+            throw InvalidPNGFormatException("pixel index more than palette size");
+        }
+        out[column] = palette_colors[color_index];
+    }
+}
+
+template <typename Pixel>
+void BasicPixelUnpacker<Pixel>::unpack_bit_reader(const uint8_t *data, std::size_t width, Pixel *out) const {
+    BitReader bit_reader(data);
+    for (std::size_t column = 0; column < width; column++) {
+        out[column] = read_pixel<Pixel>(ihdr, bit_reader, palette);
+    }
+}
+
+template <typename Pixel>
+void BasicPixelUnpacker<Pixel>::unpack(const uint8_t *data, std::size_t width, Pixel *out) const {
+    (this->*unpack_row)(data, width, out);
+}
+
+template RGB read_pixel<RGB>(IHDR ihdr, BitReader &bit_reader, std::string_view palette);
+template RGB16 read_pixel<RGB16>(IHDR ihdr, BitReader &bit_reader, std::string_view palette);
+
+template class BasicPixelUnpacker<RGB>;
+template class BasicPixelUnpacker<RGB16>;
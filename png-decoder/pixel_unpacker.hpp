@@ -0,0 +1,58 @@
+#pragma once
+
+#include "bit_reader.hpp"
+#include "ihdr.hpp"
+#include "image.hpp"
+#include <array>
+#include <string_view>
+
+int cast_to_8_bits(int val, int bit_depth);
+
+int cast_to_16_bits(int val, int bit_depth);
+
+// reads one pixel and rescales it to the channel size of Pixel: 8 bits for RGB, 16 bits for RGB16
+template <typename Pixel = RGB>
+Pixel read_pixel(IHDR ihdr, BitReader &bit_reader, std::string_view palette);
+
+// Converts unfiltered scanlines into pixels with a loop specialized for
+// the (color_type, bit_depth) pair, chosen once per image.
+// Pairs not allowed by the specification fall back to BitReader.
+// Instantiated for RGB and RGB16: with 16 bits per channel, 16-bit samples are only byte swapped from big-endian,
+// lower bit depths are scaled up by an exact multiplication, e.g. 8 bits by 257
+template <typename Pixel_>
+class BasicPixelUnpacker {
+public:
+    using Pixel = Pixel_;
+
+private:
+    IHDR ihdr;
+    std::string_view palette;
+    // palette indices have at most 8 bits
+    std::array<Pixel, 256> palette_colors;
+    std::size_t palette_colors_size = 0;
+
+    void (BasicPixelUnpacker::*unpack_row)(const uint8_t *data, std::size_t width, Pixel *out) const;
+
+    template <int channels, int bit_depth>
+    void unpack_samples(const uint8_t *data, std::size_t width, Pixel *out) const;
+
+    template <int bit_depth>
+    void unpack_packed_gray(const uint8_t *data, std::size_t width, Pixel *out) const;
+
+    template <int bit_depth>
+    void unpack_palette(const uint8_t *data, std::size_t width, Pixel *out) const;
+
+    void unpack_bit_reader(const uint8_t *data, std::size_t width, Pixel *out) const;
+
+public:
+    // palette must outlive the unpacker
+    BasicPixelUnpacker(IHDR ihdr, std::string_view palette);
+
+    // data is width pixels of the unfiltered scanline without the filter type byte,
+    // samples are rescaled to the channel size of Pixel
+    void unpack(const uint8_t *data, std::size_t width, Pixel *out) const;
+};
+
+using PixelUnpacker = BasicPixelUnpacker<RGB>;
+
+using PixelUnpacker16 = BasicPixelUnpacker<RGB16>;
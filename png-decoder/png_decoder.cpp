@@ -1,10 +1,20 @@
 #include "png_decoder.hpp"
-#include "bit_reader.hpp"
-#include "crc_calculator.hpp"
+#include "chunk_reader.hpp"
+#include "decode_limits.hpp"
 #include "deflate_wrappers.hpp"
+#include "filters.hpp"
+#include "interlace.hpp"
+#include "mapped_file.hpp"
+#include "pixel_unpacker.hpp"
+#include "scanline_reader.hpp"
+#include "thread_pool.hpp"
+#include <array>
+#include <chrono>
 #include <fstream>
-
-const uint8_t PNG_SIGNATURE[] = {137, 80, 78, 71, 13, 10, 26, 10};
+#include <mutex>
+#include <optional>
+#include <tuple>
+#include <type_traits>
 
 //==============//
 //==EXCEPTIONS==//
@@ -22,384 +32,804 @@ InvalidPNGFormatException::InvalidPNGFormatException(const std::string &message)
     : PNGDecoderException("\ninvalid PNG format: " + message) {
 }
 
-//==================//
-//==REMOVE FILTERS==//
-//==================//
+DecodeLimitException::DecodeLimitException(const std::string &message)
+    : PNGDecoderException("\ndecode limit exceeded: " + message) {
+}
 
-int PaethPredictor(int a, int b, int c) {
-    int p = a + b - c;
-    int pa = std::abs(p - a);
-    int pb = std::abs(p - b);
-    int pc = std::abs(p - c);
-    if (pa <= pb && pa <= pc) {
-        return a;
-    } else if (pb <= pc) {
-        return b;
-    } else {
-        return c;
+//=========//
+//==STATS==//
+//=========//
+
+#ifdef PNG_DECODER_STATS
+// adds its lifetime to ns
+class StageTimer {
+    std::uint64_t &ns;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+public:
+    explicit StageTimer(std::uint64_t &ns_) : ns(ns_) {
     }
+
+    ~StageTimer() {
+        ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+std::size_t count_grown_buffers(const std::array<std::size_t, 6> &before, const std::array<std::size_t, 6> &after) {
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < before.size(); i++) {
+        count += after[i] > before[i];
+    }
+    return count;
+}
+#endif
+
+//=================//
+//==PIXEL FORMATS==//
+//=================//
+
+constexpr std::size_t PIXEL_SIZES[] = {4, 4, 3, 8, 2};
+
+std::size_t get_pixel_size(PixelFormat format) {
+    return PIXEL_SIZES[static_cast<int>(format)];
+}
+
+bool is_16_bit_format(PixelFormat format) {
+    return format == PixelFormat::RGBA16 || format == PixelFormat::GRAY16;
 }
 
-void remove_sub_filter(uint8_t *data, std::size_t byte_count, std::size_t bpp) {
-    for (std::size_t byte = 0; byte < byte_count; byte++) {
-        if (byte >= bpp) {
-            data[byte] += data[byte - bpp];
+// pixels of the unpacker for the format
+template<PixelFormat Format>
+using FormatPixel = std::conditional_t<Format == PixelFormat::RGBA16 || Format == PixelFormat::GRAY16, RGB16, RGB>;
+
+// writes count pixels to out, Step pixels apart
+template<PixelFormat Format, std::size_t Step>
+void write_pixels(const FormatPixel<Format> *pixels, std::size_t count, uint8_t *out) {
+    constexpr std::size_t out_step = Step * PIXEL_SIZES[static_cast<int>(Format)];
+    for (std::size_t i = 0; i < count; i++, out += out_step) {
+        if constexpr (Format == PixelFormat::RGBA8 || Format == PixelFormat::RGBA16) {
+            std::memcpy(out, &pixels[i], sizeof(pixels[i]));
+        } else if constexpr (Format == PixelFormat::BGRA8) {
+            out[0] = pixels[i].b;
+            out[1] = pixels[i].g;
+            out[2] = pixels[i].r;
+            out[3] = pixels[i].a;
+        } else if constexpr (Format == PixelFormat::RGB8) {
+            out[0] = pixels[i].r;
+            out[1] = pixels[i].g;
+            out[2] = pixels[i].b;
+        } else {
+            // gray images have r = g = b
+            std::memcpy(out, &pixels[i].r, 2);
         }
     }
 }
 
-void remove_up_filter(uint8_t *data, std::size_t byte_count) {
-    for (std::size_t byte = 0; byte < byte_count; byte++) {
-        data[byte] += data[byte - (byte_count + 1)];
+template<typename Pixel>
+using PixelWriter = void (*)(const Pixel *pixels, std::size_t count, uint8_t *out);
+
+template<PixelFormat Format>
+PixelWriter<FormatPixel<Format>> get_pixel_writer(std::size_t step) {
+    // step_column of the Adam7 passes
+    switch (step) {
+        case 1:
+            return write_pixels<Format, 1>;
+        case 2:
+            return write_pixels<Format, 2>;
+        case 4:
+            return write_pixels<Format, 4>;
+        case 8:
+            return write_pixels<Format, 8>;
+        default:
+            throw PNGDecoderException("get_pixel_writer(), invalid step = " + std::to_string(step));
     }
 }
 
-void remove_average_filter(uint8_t *data, std::size_t byte_count, std::size_t bpp, std::size_t row) {
-    for (std::size_t byte = 0; byte < byte_count; byte++) {
-        int left = 0;
-        if (byte >= bpp) {
-            left = data[byte - bpp];
+// Pixel is RGB for the 8-bit formats and RGB16 for the 16-bit ones
+template<typename Pixel>
+PixelWriter<Pixel> get_pixel_writer(PixelFormat format, std::size_t step) {
+    if constexpr (std::is_same_v<Pixel, RGB>) {
+        switch (format) {
+            case PixelFormat::RGBA8:
+                return get_pixel_writer<PixelFormat::RGBA8>(step);
+            case PixelFormat::BGRA8:
+                return get_pixel_writer<PixelFormat::BGRA8>(step);
+            case PixelFormat::RGB8:
+                return get_pixel_writer<PixelFormat::RGB8>(step);
+            default:
+                break;
         }
-        int top = 0;
-        if (row != 0) {
-            top = data[byte - (byte_count + 1)];
+    } else {
+        switch (format) {
+            case PixelFormat::RGBA16:
+                return get_pixel_writer<PixelFormat::RGBA16>(step);
+            case PixelFormat::GRAY16:
+                return get_pixel_writer<PixelFormat::GRAY16>(step);
+            default:
+                break;
         }
-        data[byte] += (top + left) / 2;
     }
+    throw PNGDecoderException("get_pixel_writer(), invalid format");
 }
 
-void remove_paeth_filter(uint8_t *data, std::size_t byte_count, std::size_t bpp, std::size_t row) {
-    for (std::size_t byte = 0; byte < byte_count; byte++) {
-        int left = 0;
-        if (byte >= bpp) {
-            left = data[byte - bpp];
-        }
-        int top = 0;
-        if (row > 0) {
-            top = data[byte - (byte_count + 1)];
-        }
-        int top_left = 0;
-        if (byte >= bpp && row > 0) {
-            top_left = data[byte - (byte_count + 1) - bpp];
-        }
-        data[byte] += PaethPredictor(left, top, top_left);
+//==================//
+//==STREAM DECODER==//
+//==================//
+
+// reads all scanlines left in the reader into the image
+Image read_image(ScanlineReader &reader) {
+    IHDR ihdr = reader.get_ihdr();
+    std::size_t bpp = (ihdr.get_pixel_len_in_bits() + 7) / 8;
+    PixelUnpacker unpacker(ihdr, reader.get_palette());
+    std::vector<RGB> pixels(ihdr.width);
+
+    Image result(ihdr.height, ihdr.width);
+    while (reader.next_scanline()) {
+        const InterlacePass &pass = INTERLACE_PASSES[reader.get_pass()];
+        uint8_t *scanline = reader.get_scanline();
+        remove_filter(scanline, reader.get_previous_scanline(), reader.get_row_len_in_bytes(), bpp);
+        unpacker.unpack(scanline + 1, reader.get_width(), pixels.data());
+
+        std::size_t row = pass.start_row + reader.get_row() * pass.step_row;
+        PixelWriter<RGB> write_pixels = get_pixel_writer<RGB>(PixelFormat::RGBA8, pass.step_column);
+        write_pixels(pixels.data(), reader.get_width(), reinterpret_cast<uint8_t *>(&result(row, pass.start_column)));
     }
+
+    return result;
 }
 
-void remove_filters(uint8_t *data, std::size_t pixel_len_in_bits, std::size_t row_len_in_bytes, std::size_t height) {
-    std::size_t bpp = (pixel_len_in_bits + 7) / 8;
+//===============//
+//==PNG DECODER==//
+//===============//
 
-    for (std::size_t row = 0; row < height; row++, data += row_len_in_bytes + 1) {
-        if (*data == 0) {
-            // нет фильтров
-        } else if (*data == 1) {
-            remove_sub_filter(data + 1, row_len_in_bytes, bpp);
-        } else if (*data == 2) {
-            if (row != 0) {
-                remove_up_filter(data + 1, row_len_in_bytes);
-            }
-        } else if (*data == 3) {
-            remove_average_filter(data + 1, row_len_in_bytes, bpp, row);
-        } else if (*data == 4) {
-            remove_paeth_filter(data + 1, row_len_in_bytes, bpp, row);
-        } else {
-            throw InvalidPNGFormatException("invalid row filter mode = " + std::to_string(*data) + ", != 0-4");
+// reads the next IDAT chunk, idat_data views all IDAT payloads read so far
+void append_idat(std::istream &input, ChunkHeader &chunk, bool need_to_check_crc,
+                 std::string &data_accum, std::string_view &idat_data) {
+    // read in place at the end of data_accum, which grows only as the data arrives
+    append_chunk_data(input, chunk, data_accum, need_to_check_crc);
+    idat_data = data_accum;
+}
+
+// the only IDAT is viewed in place, several ones are gathered into data_accum
+void append_idat(MemoryInput &input, ChunkHeader &chunk, bool need_to_check_crc,
+                 std::string &data_accum, std::string_view &idat_data) {
+    std::string_view chunk_data(read_chunk_data(input, chunk, need_to_check_crc), chunk.data_length);
+    if (data_accum.empty()) {
+        if (idat_data.empty()) {
+            idat_data = chunk_data;
+            return;
         }
+        // the rest of the input is an upper bound for the other IDAT chunks
+        data_accum.reserve(idat_data.size() + chunk_data.size() + (input.size - input.offset));
+        data_accum = idat_data;
     }
+    data_accum += chunk_data;
+    idat_data = data_accum;
 }
 
-//===========//
-//==READING==//
-//===========//
-
-enum class read_context_t {
-    PNG_SIGNATURE,
-    CHUNK_DATA_LENGTH,
-    CHUNK_TYPE_CODE,
-    CHUNK_DATA,
-    CHUNK_CRC
-};
+// buffer is used only if the data can't be viewed in place
+std::string_view read_chunk_view(std::istream &input, ChunkHeader &chunk, bool need_to_check_crc, std::string &buffer) {
+    buffer.resize(chunk.data_length);
+    read_chunk_data(input, chunk, buffer.data(), need_to_check_crc);
+    return buffer;
+}
 
-void read_bytes(std::istream &input, void *buffer, int byte_count, read_context_t type, bool need_to_reverse_bytes) {
-    char *buffer_char = reinterpret_cast<char *>(buffer);
-    try {
-        input.read(buffer_char, byte_count);
-        if (need_to_reverse_bytes) {
-            std::reverse(buffer_char, buffer_char + byte_count);
-        }
-    } catch (std::exception &error) {
-        std::string context;
-        if (type == read_context_t::PNG_SIGNATURE) {
-            context = "png signature";
-        } else if (type == read_context_t::CHUNK_DATA_LENGTH) {
-            context = "chunk data length";
-        } else if (type == read_context_t::CHUNK_TYPE_CODE) {
-            context = "chunk type code";
-        } else if (type == read_context_t::CHUNK_DATA) {
-            context = "chunk data";
-        } else if (type == read_context_t::CHUNK_CRC) {
-            context = "chunk CRC";
-        }
+std::string_view read_chunk_view(MemoryInput &input, ChunkHeader &chunk, bool need_to_check_crc, std::string &) {
+    return {read_chunk_data(input, chunk, need_to_check_crc), chunk.data_length};
+}
 
-        throw FailedToReadException("\"" + context + "\"\ncaught message: " + error.what());
+bool need_to_check_chunk_crc(const DecodeOptions &options, const ChunkHeader &chunk) {
+    switch (options.crc_check_mode) {
+        case CrcCheckMode::ALL:
+            return true;
+        case CrcCheckMode::CRITICAL_ONLY:
+            return !is_ancillary_chunk(chunk);
+        case CrcCheckMode::NONE:
+            return false;
     }
+    return true;
 }
 
-void read_signature(std::istream &input) {
-    char signature[8];
-    read_bytes(input, signature, 8, read_context_t::PNG_SIGNATURE, false);
+template<typename Input>
+void PNGDecoder::read_chunks(Input &input) {
+#ifdef PNG_DECODER_STATS
+    std::array<std::size_t, 6> capacities = context->get_capacities();
+    std::optional<StageTimer> stage_timer(std::in_place, stats.read_chunks_ns);
+    std::uint64_t start_crc_ns = chunk_crc_ns;
+    stats.input_bytes += 8;
+#endif
+    read_signature(input);
+
+    // IDAT payloads are gathered at the end of data_accum if they can't be viewed in place,
+    // IHDR and PLTE reuse one buffer
+    std::string &data_accum = context->data_accum;
+    std::string &chunk_buffer = context->chunk_buffer;
+    std::string &palette = context->palette;
+    data_accum.clear();
+    palette.clear();
+    std::string_view idat_data;
+
+    const DecodeLimits &limits = options.limits;
+    std::size_t chunk_count = 0;
+    std::size_t ancillary_bytes = 0;
+
+    bool is_read_ihdr = false;
+    bool is_read_palette = false;
+    while (true) {
+        ChunkHeader chunk = read_chunk_header(input);
+        check_chunk_limits(chunk, limits, chunk_count, ancillary_bytes);
+
+        bool need_to_check_crc = need_to_check_chunk_crc(options, chunk);
+        if (need_to_check_crc) {
+            counters.checked_crc_count++;
+        } else {
+            counters.skipped_crc_count++;
+        }
+#ifdef PNG_DECODER_STATS
+        // length, type code, data and CRC
+        stats.input_bytes += 12 + chunk.data_length;
+        stats.chunk_count++;
+        stats.ancillary_chunk_count += is_ancillary_chunk(chunk);
+#endif
+
+        if (memcmp(chunk.type_code, "IDAT", 4) == 0) {
+            append_idat(input, chunk, need_to_check_crc, data_accum, idat_data);
+#ifdef PNG_DECODER_STATS
+            stats.compressed_bytes += chunk.data_length;
+            stats.idat_chunk_count++;
+#endif
+            continue;
+        }
 
-    if (std::memcmp(PNG_SIGNATURE, signature, 8) != 0) {
-        std::string actual_values;
-        for (std::size_t byte = 0; byte < 8; byte++) {
-            actual_values += std::to_string(static_cast<uint8_t>(signature[byte]));
-            if (byte != 7) {
-                actual_values += ' ';
+        // only IHDR and PLTE are kept, their lengths are checked before reading,
+        // the data of the other chunks is skipped without buffering it
+        if (memcmp(chunk.type_code, "IHDR", 4) == 0) {
+            check_chunk_data_length(chunk, IHDR_DATA_LENGTH);
+            is_read_ihdr = true;
+            ihdr.read(read_chunk_view(input, chunk, need_to_check_crc, chunk_buffer));
+            check_image_limits(ihdr, limits);
+        } else if (memcmp(chunk.type_code, "PLTE", 4) == 0) {
+            check_chunk_data_length(chunk, MAX_PLTE_DATA_LENGTH - palette.size());
+            is_read_palette = true;
+            palette += read_chunk_view(input, chunk, need_to_check_crc, chunk_buffer);
+        } else {
+            skip_chunk_data(input, chunk, need_to_check_crc);
+            if (memcmp(chunk.type_code, "IEND", 4) == 0) {
+                break;
             }
         }
-        throw InvalidPNGFormatException("invalid signature: " + actual_values);
     }
-}
 
-std::string read_chunk(std::istream &input, char chunk_type_code[4]) {
-    uint32_t data_length;
-    read_bytes(input, &data_length, 4, read_context_t::CHUNK_DATA_LENGTH, true);
+    if (!is_read_ihdr) {
+        throw InvalidPNGFormatException("missing chunk \"IHDR\"");
+    }
+
+    if (!is_read_palette && ihdr.color_type == 3) {
+        throw InvalidPNGFormatException("missing chunk \"PLTE\", but palette is used");
+    }
 
-    if (data_length > (static_cast<uint32_t>(1) << 31)) {
-        throw InvalidPNGFormatException("invalid chunk data length: " + std::to_string(data_length) + ", more than 2^31");
+    check_deadline(limits);
+#ifdef PNG_DECODER_STATS
+    stats.crc_ns += chunk_crc_ns - start_crc_ns;
+    stage_timer.emplace(stats.inflate_ns);
+#endif
+    context->deflate_wrapper->deflate(idat_data, get_pixels_data_size(ihdr), options.need_to_check_adler32,
+                                      context->pixels_data);
+    if (!options.need_to_check_adler32) {
+        counters.skipped_adler32_count++;
     }
+    check_deadline(limits);
+#ifdef PNG_DECODER_STATS
+    stage_timer.reset();
+    stats.decompressed_bytes += context->pixels_data.size();
+    stats.buffer_allocation_count += count_grown_buffers(capacities, context->get_capacities());
+#endif
+}
 
-    read_bytes(input, chunk_type_code, 4, read_context_t::CHUNK_TYPE_CODE, false);
+DecoderContext::DecoderContext() : deflate_wrapper(std::make_unique<DeflateWrapper>()) {
+}
 
-    std::string data(data_length, '\0');
+DecoderContext::~DecoderContext() = default;
 
-    read_bytes(input, data.data(), data_length, read_context_t::CHUNK_DATA, false);
+#ifdef PNG_DECODER_STATS
+std::array<std::size_t, 6> DecoderContext::get_capacities() const {
+    return {data_accum.capacity(), chunk_buffer.capacity(), pixels_data.capacity(), palette.capacity(),
+            std::get<0>(pixels).capacity(), std::get<1>(pixels).capacity()};
+}
+#endif
 
-    uint32_t actual_crc;
-    read_bytes(input, &actual_crc, 4, read_context_t::CHUNK_CRC, true);
+PNGDecoder::PNGDecoder(std::istream &input, DecodeOptions options_)
+    : own_context(std::make_unique<DecoderContext>()), context(own_context.get()), options(options_) {
+    read_chunks(input);
+}
 
-    crc_calculator::reset();
-    crc_calculator::add_bytes(chunk_type_code, 4);
-    crc_calculator::add_bytes(data.data(), data_length);
-    uint32_t correct_crc = crc_calculator::get_checksum();
+PNGDecoder::PNGDecoder(std::span<const uint8_t> data, DecodeOptions options_)
+    : own_context(std::make_unique<DecoderContext>()), context(own_context.get()), options(options_) {
+    MemoryInput input{data.data(), data.size()};
+    read_chunks(input);
+}
 
-    if (actual_crc != correct_crc) {
-        throw InvalidPNGFormatException("\ninvalid CRC: actual = " + std::to_string(actual_crc) +
-                                        ", correct = " + std::to_string(correct_crc));
-    }
+PNGDecoder::PNGDecoder(std::istream &input, DecoderContext &context_, DecodeOptions options_)
+    : context(&context_), options(options_) {
+    read_chunks(input);
+}
+
+PNGDecoder::PNGDecoder(std::span<const uint8_t> data, DecoderContext &context_, DecodeOptions options_)
+    : context(&context_), options(options_) {
+    MemoryInput input{data.data(), data.size()};
+    read_chunks(input);
+}
 
-    return data;
+const IHDR &PNGDecoder::get_ihdr() const {
+    return ihdr;
 }
 
-RGB read_pixel(IHDR ihdr, BitReader &bit_reader, const std::string &palette) {
-    RGB result;
-    {
-        std::size_t alpha_channel_bit_depth = ihdr.bit_depth;
-        if (ihdr.color_type == 3) {// PLTE
-            alpha_channel_bit_depth = 8;
+const DecodeCounters &PNGDecoder::get_counters() const {
+    return counters;
+}
+
+#ifdef PNG_DECODER_STATS
+const DecodeStats &PNGDecoder::get_stats() const {
+    return stats;
+}
+#endif
+
+// pass pass_cnt is pixels_data[offsets[pass_cnt], offsets[pass_cnt + 1]),
+// throws if the size of pixels data doesn't match the passes
+std::array<std::size_t, 9> get_pass_offsets(IHDR ihdr, std::size_t pixels_data_size) {
+    std::array<std::size_t, 9> offsets{};
+    std::size_t pixels_data_avail = pixels_data_size;
+
+    int first_pass_cnt = ihdr.interlace_method == 0 ? 0 : 1;
+    int last_pass_cnt = ihdr.interlace_method == 0 ? 0 : 7;
+    for (int pass_cnt = 0; pass_cnt < 8; pass_cnt++) {
+        std::size_t subimage_size = 0;
+        if (first_pass_cnt <= pass_cnt && pass_cnt <= last_pass_cnt) {
+            subimage_size = get_subimage_data_size(ihdr, pass_cnt);
         }
-        result.a = (1 << alpha_channel_bit_depth) - 1;
-    }
-
-    if (ihdr.color_type == 0) {
-        result.r = result.g = result.b = bit_reader.read(ihdr.bit_depth);
-    } else if (ihdr.color_type == 2) {
-        result.r = bit_reader.read(ihdr.bit_depth);
-        result.g = bit_reader.read(ihdr.bit_depth);
-        result.b = bit_reader.read(ihdr.bit_depth);
-    } else if (ihdr.color_type == 3) {
-        std::size_t color_index = bit_reader.read(ihdr.bit_depth);
-        color_index *= 3;
-        if (color_index + 2 >= palette.size()) {
-            throw InvalidPNGFormatException("pixel index more than palette size");
+
+        if (pixels_data_avail < subimage_size) {
+            throw InvalidPNGFormatException("short pixel data length");
         }
-        result.r = static_cast<uint8_t>(palette[color_index]);
-        result.g = static_cast<uint8_t>(palette[color_index + 1]);
-        result.b = static_cast<uint8_t>(palette[color_index + 2]);
-    } else if (ihdr.color_type == 4) {
-        result.r = result.g = result.b = bit_reader.read(ihdr.bit_depth);
-        result.a = bit_reader.read(ihdr.bit_depth);
-    } else if (ihdr.color_type == 6) {
-        result.r = bit_reader.read(ihdr.bit_depth);
-        result.g = bit_reader.read(ihdr.bit_depth);
-        result.b = bit_reader.read(ihdr.bit_depth);
-        result.a = bit_reader.read(ihdr.bit_depth);
-    } else {
-        throw PNGDecoderException("call read_pixel(), invalid ihdr.color_type = " +
-                                  std::to_string(ihdr.color_type) + ", != 0, 2, 3, 4 or 6");
+        pixels_data_avail -= subimage_size;
+        offsets[pass_cnt + 1] = offsets[pass_cnt] + subimage_size;
     }
-    return result;
-}
-
-//===============//
-//==UNINTERLACE==//
-//===============//
 
-// return (height, width)
-std::pair<std::size_t, std::size_t> get_subimage_shape_in_interlace(int pass_cnt, std::size_t image_height, std::size_t image_width) {
-    switch (pass_cnt) {
-        case 0:
-            return {image_height, image_width};
-        case 1:
-            return {(image_height + 7) / 8, (image_width + 7) / 8};
-        case 2:
-            return {(image_height + 7) / 8, (image_width - 4 + 7) / 8};
-        case 3:
-            return {(image_height - 4 + 7) / 8, (image_width + 3) / 4};
-        case 4:
-            return {(image_height + 3) / 4, (image_width - 2 + 3) / 4};
-        case 5:
-            return {(image_height - 2 + 3) / 4, (image_width + 1) / 2};
-        case 6:
-            return {(image_height + 1) / 2, (image_width - 1 + 1) / 2};
-        case 7:
-            return {(image_height - 1 + 1) / 2, image_width};
+    if (pixels_data_avail != 0) {
+        throw InvalidPNGFormatException("too much length pixel data");
     }
-    throw PNGDecoderException("call get_subimage_shape_in_interlace(), invalid pass_cnt = " +
-                              std::to_string(pass_cnt) + ", != 0-7");
+    return offsets;
 }
 
-Image uninterlace(IHDR ihdr, const std::string &palette, int pass_cnt, uint8_t *data) {
+void remove_pass_filters(IHDR ihdr, int pass_cnt, uint8_t *data, ThreadPool *pool) {
     auto [height, width] = get_subimage_shape_in_interlace(pass_cnt, ihdr.height, ihdr.width);
-
     std::size_t pixel_len_in_bits = ihdr.get_pixel_len_in_bits();
     std::size_t row_len_in_bytes = (pixel_len_in_bits * width + 7) / 8;
+    if (pool != nullptr) {
+        remove_filters_parallel(data, pixel_len_in_bits, row_len_in_bytes, height, *pool);
+    } else {
+        remove_filters(data, pixel_len_in_bits, row_len_in_bytes, height);
+    }
+}
 
-    remove_filters(data, pixel_len_in_bits, row_len_in_bytes, height);
-
-    BitReader bit_reader(data);
+// ns per byte of remove_filter, by filter type and bpp - 1: the time of
+// `bench_png_decoder --benchmark_filter=BM_RemoveFilter` divided by the bytes of one iteration,
+// Release build (GCC 12, -O3) on one core of an Intel Xeon, so other machines need their own calibration.
+// bpp 5 and 7 don't occur, they repeat bpp 6 and 8. The benchmark unfilters random bytes, the worst case
+// for the branches of scalar Paeth (bpp other than 3 and 4), so Paeth-heavy images are usually faster than predicted
+constexpr double REMOVE_FILTER_NS_PER_BYTE[5][8] = {
+        {0, 0, 0, 0, 0, 0, 0, 0},
+        {0.18, 0.13, 0.28, 0.12, 0.19, 0.19, 0.1, 0.1},
+        {0.055, 0.05, 0.054, 0.054, 0.059, 0.059, 0.064, 0.064},
+        {3.3, 1.6, 0.8, 0.6, 0.4, 0.4, 0.36, 0.36},
+        {10.5, 8.8, 1.5, 1.0, 8.8, 8.8, 9.5, 9.5},
+};
 
-    Image result(height, width);
+// BM_PixelUnpacker, about the same for all color types
+constexpr double UNPACK_NS_PER_PIXEL = 1.0;
 
-    for (std::size_t row = 0; row < height; row++) {
-        bit_reader.read(8);// skip byte filter type
-        for (std::size_t column = 0; column < width; column++) {
-            result(row, column) = read_pixel(ihdr, bit_reader, palette);
+// data is the pixels data with the filter type bytes in place, before or after unfiltering
+DecodeCost estimate_decode_cost(IHDR ihdr, const std::array<std::size_t, 9> &offsets, const uint8_t *data) {
+    DecodeCost cost;
+    std::size_t pixel_len_in_bits = ihdr.get_pixel_len_in_bits();
+    std::size_t bpp = (pixel_len_in_bits + 7) / 8;
+    for (int pass_cnt = 0; pass_cnt < 8; pass_cnt++) {
+        if (offsets[pass_cnt] == offsets[pass_cnt + 1]) {
+            continue;
+        }
+        auto [height, width] = get_subimage_shape_in_interlace(pass_cnt, ihdr.height, ihdr.width);
+        std::size_t row_len_in_bytes = (pixel_len_in_bits * width + 7) / 8;
+        std::array<std::size_t, 5> pass_counts{};
+        count_filter_types(data + offsets[pass_cnt], row_len_in_bytes, height, pass_counts);
+        for (std::size_t filter_type = 0; filter_type < 5; filter_type++) {
+            cost.filter_type_counts[filter_type] += pass_counts[filter_type];
+            cost.filter_type_bytes[filter_type] += pass_counts[filter_type] * row_len_in_bytes;
         }
-        bit_reader.read((8 - (pixel_len_in_bits * width) % 8) % 8);// skip to byte
+        cost.pixel_count += height * width;
     }
-    return result;
+
+    cost.predicted_ns = UNPACK_NS_PER_PIXEL * static_cast<double>(cost.pixel_count);
+    for (std::size_t filter_type = 0; filter_type < 5; filter_type++) {
+        cost.predicted_ns +=
+                REMOVE_FILTER_NS_PER_BYTE[filter_type][bpp - 1] * static_cast<double>(cost.filter_type_bytes[filter_type]);
+    }
+    return cost;
 }
 
-//===============//
-//==PNG DECODER==//
-//===============//
+// unpacks the unfiltered pass and writes its pixels to their positions in dst,
+// pixels is the scratch row of at least pass width
+template<typename Unpacker, typename Pixel = typename Unpacker::Pixel>
+void write_pass(IHDR ihdr, int pass_cnt, const uint8_t *data, const Unpacker &unpacker, Pixel *pixels,
+                uint8_t *dst, std::size_t stride, PixelFormat format) {
+    const InterlacePass &pass = INTERLACE_PASSES[pass_cnt];
+    auto [height, width] = get_subimage_shape_in_interlace(pass_cnt, ihdr.height, ihdr.width);
+    std::size_t row_len_in_bytes = (ihdr.get_pixel_len_in_bits() * width + 7) / 8;
+    std::size_t pixel_size = get_pixel_size(format);
+    // contiguous RGBA8 (or aligned RGBA16) rows are unpacked in place, others are scattered from the scratch row
+    bool is_direct = pass.step_column == 1 &&
+                     format == (std::is_same_v<Pixel, RGB> ? PixelFormat::RGBA8 : PixelFormat::RGBA16) &&
+                     reinterpret_cast<std::uintptr_t>(dst) % alignof(Pixel) == 0 && stride % alignof(Pixel) == 0;
+    PixelWriter<Pixel> write_pixels = get_pixel_writer<Pixel>(format, pass.step_column);
+
+    uint8_t *out = dst + pass.start_row * stride + pass.start_column * pixel_size;
+    for (std::size_t row = 0; row < height; row++, data += row_len_in_bytes + 1, out += pass.step_row * stride) {
+        // skip byte filter type
+        if (is_direct) {
+            unpacker.unpack(data + 1, width, reinterpret_cast<Pixel *>(out));
+        } else {
+            unpacker.unpack(data + 1, width, pixels);
+            write_pixels(pixels, width, out);
+        }
+    }
+}
 
-PNGDecoder::PNGDecoder(std::istream &input) {
-    read_signature(input);
+DecodeCost PNGDecoder::get_decode_cost() const {
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(context->pixels_data.data());
+    return estimate_decode_cost(ihdr, get_pass_offsets(ihdr, context->pixels_data.size()), data);
+}
 
-    std::string data_accum;
+void PNGDecoder::remove_all_filters() {
+    if (is_filters_removed) {
+        return;
+    }
 
-    bool is_read_ihdr = false;
-    bool is_read_palette = false;
-    while (true) {
-        char chunk_type_code[4];
-        auto chunk_data = read_chunk(input, chunk_type_code);
-        if (memcmp(chunk_type_code, "IHDR", 4) == 0) {
-            is_read_ihdr = true;
-            ihdr.read(chunk_data);
-        } else if (memcmp(chunk_type_code, "IDAT", 4) == 0) {
-            data_accum += chunk_data;
-        } else if (memcmp(chunk_type_code, "PLTE", 4) == 0) {
-            is_read_palette = true;
-            palette += chunk_data;
-        } else if (memcmp(chunk_type_code, "IEND", 4) == 0) {
-            break;
+#ifdef PNG_DECODER_STATS
+    StageTimer stage_timer(stats.remove_filters_ns);
+#endif
+    uint8_t *data = reinterpret_cast<uint8_t *>(context->pixels_data.data());
+    std::array<std::size_t, 9> offsets = get_pass_offsets(ihdr, context->pixels_data.size());
+    // stays set if a pass throws
+    is_failed = true;
+    for (int pass_cnt = 0; pass_cnt < 8; pass_cnt++) {
+        if (offsets[pass_cnt] != offsets[pass_cnt + 1]) {
+            check_deadline(options.limits);
+            remove_pass_filters(ihdr, pass_cnt, data + offsets[pass_cnt], options.thread_pool);
         }
     }
 
-    if (!is_read_ihdr) {
-        throw InvalidPNGFormatException("missing chunk \"IHDR\"");
+    is_failed = false;
+    is_filters_removed = true;
+#ifdef PNG_DECODER_STATS
+    // the filter type bytes are left as they were
+    stats.filter_type_counts = estimate_decode_cost(ihdr, offsets, data).filter_type_counts;
+#endif
+}
+
+void PNGDecoder::decode_into(uint8_t *dst, std::size_t stride, PixelFormat format) {
+    if (is_failed) {
+        throw PNGDecoderException("call decode_into() after a failed one, the pixels data is partially unfiltered");
+    }
+    std::size_t pixel_size = get_pixel_size(format);
+    if (stride < pixel_size * ihdr.width) {
+        throw PNGDecoderException("call decode_into(), stride = " + std::to_string(stride) +
+                                  ", less than " + std::to_string(pixel_size * ihdr.width));
+    }
+    if (format == PixelFormat::GRAY16 && ihdr.color_type != 0 && ihdr.color_type != 4) {
+        throw PNGDecoderException("call decode_into(), GRAY16 for not grayscale color_type = " +
+                                  std::to_string(ihdr.color_type));
     }
 
-    if (!is_read_palette && ihdr.color_type == 3) {
-        throw InvalidPNGFormatException("missing chunk \"PLTE\", but palette is used");
+    if (is_16_bit_format(format)) {
+        decode_passes(PixelUnpacker16(ihdr, context->palette), dst, stride, format);
+    } else {
+        decode_passes(PixelUnpacker(ihdr, context->palette), dst, stride, format);
     }
+}
 
-    DeflateWrapper deflate_wrapper;
-    pixels_data = deflate_wrapper.deflate(data_accum);
+template<typename Unpacker>
+void PNGDecoder::decode_passes(const Unpacker &unpacker, uint8_t *dst, std::size_t stride, PixelFormat format) {
+    using Pixel = typename Unpacker::Pixel;
+    uint8_t *data = reinterpret_cast<uint8_t *>(context->pixels_data.data());
+    std::array<std::size_t, 9> offsets = get_pass_offsets(ihdr, context->pixels_data.size());
+
+#ifdef PNG_DECODER_STATS
+    stats.output_bytes += get_pixel_size(format) * ihdr.width * ihdr.height;
+#endif
+
+    if (ihdr.interlace_method == 1 && options.thread_pool != nullptr && !is_filters_removed) {
+#ifdef PNG_DECODER_STATS
+        // every task adds only its own times
+        std::array<std::uint64_t, 7> remove_filters_ns{};
+        std::array<std::uint64_t, 7> write_pixels_ns{};
+#endif
+        // the passes are independent subimages writing disjoint pixels of dst,
+#ifdef PNG_DECODER_STATS
+        std::array<std::size_t, 6> capacities = context->get_capacities();
+#endif
+        // a scratch row for every task
+        std::vector<Pixel> &pixels = std::get<std::vector<Pixel>>(context->pixels);
+        pixels.resize(7 * static_cast<std::size_t>(ihdr.width));
+        // every one is unfiltered and unpacked by its own task, stays set if a task throws
+        is_failed = true;
+        options.thread_pool->parallel_for(7, [&](std::size_t task) {
+            int pass_cnt = static_cast<int>(task) + 1;
+            if (offsets[pass_cnt] == offsets[pass_cnt + 1]) {
+                return;
+            }
+            check_deadline(options.limits);
+#ifdef PNG_DECODER_STATS
+            std::optional<StageTimer> stage_timer(std::in_place, remove_filters_ns[task]);
+#endif
+            // the last passes are the largest, they can be split further
+            remove_pass_filters(ihdr, pass_cnt, data + offsets[pass_cnt], options.thread_pool);
+#ifdef PNG_DECODER_STATS
+            stage_timer.emplace(write_pixels_ns[task]);
+#endif
+            check_deadline(options.limits);
+            write_pass(ihdr, pass_cnt, data + offsets[pass_cnt], unpacker, pixels.data() + task * ihdr.width, dst,
+                       stride, format);
+        });
+        is_failed = false;
+        is_filters_removed = true;
+#ifdef PNG_DECODER_STATS
+        for (std::size_t task = 0; task < 7; task++) {
+            stats.remove_filters_ns += remove_filters_ns[task];
+            stats.write_pixels_ns += write_pixels_ns[task];
+        }
+        stats.buffer_allocation_count += count_grown_buffers(capacities, context->get_capacities());
+        stats.filter_type_counts = estimate_decode_cost(ihdr, offsets, data).filter_type_counts;
+#endif
+        return;
+    }
+
+    remove_all_filters();
+
+#ifdef PNG_DECODER_STATS
+    std::array<std::size_t, 6> capacities = context->get_capacities();
+    StageTimer stage_timer(stats.write_pixels_ns);
+#endif
+    std::vector<Pixel> &pixels = std::get<std::vector<Pixel>>(context->pixels);
+    pixels.resize(ihdr.interlace_method == 0 && format == PixelFormat::RGBA8 ? 0 : ihdr.width);
+    for (int pass_cnt = 0; pass_cnt < 8; pass_cnt++) {
+        if (offsets[pass_cnt] != offsets[pass_cnt + 1]) {
+            check_deadline(options.limits);
+            write_pass(ihdr, pass_cnt, data + offsets[pass_cnt], unpacker, pixels.data(), dst, stride, format);
+        }
+    }
+#ifdef PNG_DECODER_STATS
+    stats.buffer_allocation_count += count_grown_buffers(capacities, context->get_capacities());
+#endif
 }
 
 Image PNGDecoder::build_image() {
     Image result(ihdr.height, ihdr.width);
+    decode_into(reinterpret_cast<uint8_t *>(&result(0, 0)), get_pixel_size(PixelFormat::RGBA8) * ihdr.width,
+                PixelFormat::RGBA8);
+    return result;
+}
 
-    auto set_subimage = [&](const Image &subimage,
-                            std::size_t start_row, std::size_t start_column,
-                            std::size_t step_row, std::size_t step_column) {
-        for (uint32_t row = start_row, uninterlace_row = 0; row < ihdr.height;
-             row += step_row, uninterlace_row++) {
-            for (uint32_t column = start_column, uninterlace_column = 0; column < ihdr.width;
-                 column += step_column, uninterlace_column++) {
-                result(row, column) = subimage(uninterlace_row, uninterlace_column);
-            }
-        }
-    };
+Image16 PNGDecoder::build_image16() {
+    Image16 result(ihdr.height, ihdr.width);
+    decode_into(reinterpret_cast<uint8_t *>(&result(0, 0)), get_pixel_size(PixelFormat::RGBA16) * ihdr.width,
+                PixelFormat::RGBA16);
+    return result;
+}
 
-    // (pass_cnt, start_row, start_column, step_row, step_column)
-    std::vector<std::vector<int>> image_build_args;
-    if (ihdr.interlace_method == 0) {
-        image_build_args = {
-                {0, 0, 0, 1, 1},
-        };
-    } else {
-        image_build_args = {
-                {1, 0, 0, 8, 8},
-                {2, 0, 4, 8, 8},
-                {3, 4, 0, 8, 4},
-                {4, 0, 2, 4, 4},
-                {5, 2, 0, 4, 2},
-                {6, 0, 1, 2, 2},
-                {7, 1, 0, 2, 1},
-        };
+std::ifstream open_png_file(std::string_view filename) {
+    std::ifstream file_input(filename.data(), std::ios_base::in | std::ios_base::binary);
+    // сначала нужно проверить, что файл открыт
+    if (!file_input.is_open()) {
+        throw PNGDecoderException("Unable to open file \"" + std::string(filename) + "\"");
     }
+    // а уже потом ставить обработку исключений, иначе упадет
+    file_input.exceptions(std::ios_base::failbit | std::ios_base::badbit);
+    return file_input;
+}
 
-    uint8_t *data = reinterpret_cast<uint8_t *>(pixels_data.data());
-    std::size_t pixels_data_avail = pixels_data.size();
+// build is &PNGDecoder::build_image or &PNGDecoder::build_image16
+template<typename Build>
+auto read_png(std::string_view filename, DecoderContext &context, DecodeOptions options, Build build) {
+    MappedFile mapped_file(filename);
+    if (mapped_file.is_mapped()) {
+        return (PNGDecoder(mapped_file.get_data(), context, options).*build)();
+    }
+    // pipes, devices and platforms without mmap
+    std::ifstream file_input = open_png_file(filename);
+    return (PNGDecoder(file_input, context, options).*build)();
+}
 
-    for (auto vals: image_build_args) {
-        auto [height, width] = get_subimage_shape_in_interlace(vals[0], ihdr.height, ihdr.width);
+Image read_png(std::string_view filename, DecoderContext &context, DecodeOptions options) {
+    return read_png(filename, context, options, &PNGDecoder::build_image);
+}
 
-        std::size_t pixel_len_in_bits = ihdr.get_pixel_len_in_bits();
-        std::size_t row_len_in_bytes = (pixel_len_in_bits * width + 7) / 8;
-        std::size_t subimage_size = (row_len_in_bytes + 1) * height;
+Image ReadPng(std::string_view filename, DecodeOptions options) {
+    DecoderContext context;
+    return read_png(filename, context, options);
+}
 
-        if (pixels_data_avail < subimage_size) {
-            throw InvalidPNGFormatException("short pixel data length");
-        }
-        pixels_data_avail -= subimage_size;
+Image16 ReadPng16(std::string_view filename, DecodeOptions options) {
+    DecoderContext context;
+    return read_png(filename, context, options, &PNGDecoder::build_image16);
+}
 
-        set_subimage(uninterlace(ihdr, palette, vals[0], data), vals[1], vals[2], vals[3], vals[4]);
+Image ReadPngStreaming(std::string_view filename, DecodeLimits limits) {
+    std::ifstream file_input = open_png_file(filename);
+    ScanlineReader reader(file_input, limits);
+    return read_image(reader);
+}
+
+//=========//
+//==PROBE==//
+//=========//
+
+template<typename Input>
+ProbeResult probe_png(Input &input, bool need_to_scan_chunks) {
+    read_signature(input);
 
-        data += subimage_size;
+    ProbeResult result;
+    ChunkHeader chunk = read_chunk_header(input);
+    if (memcmp(chunk.type_code, "IHDR", 4) != 0) {
+        throw InvalidPNGFormatException("missing chunk \"IHDR\"");
     }
+    check_chunk_data_length(chunk, IHDR_DATA_LENGTH);
+    std::string buffer;
+    result.ihdr.read(read_chunk_view(input, chunk, true, buffer));
+
+    // PLTE, tRNS and acTL come before the first IDAT, so the image data is never read,
+    // only their presence is needed and the data of every chunk is skipped
+    while (need_to_scan_chunks) {
+        chunk = read_chunk_header(input);
+        if (memcmp(chunk.type_code, "IDAT", 4) == 0) {
+            break;
+        }
+        if (memcmp(chunk.type_code, "IEND", 4) == 0) {
+            throw InvalidPNGFormatException("missing chunk \"IDAT\"");
+        }
 
-    if (pixels_data_avail != 0) {
-        throw InvalidPNGFormatException("too much length pixel data");
+        if (memcmp(chunk.type_code, "PLTE", 4) == 0) {
+            check_chunk_data_length(chunk, MAX_PLTE_DATA_LENGTH);
+            result.has_palette = true;
+        } else if (memcmp(chunk.type_code, "tRNS", 4) == 0) {
+            check_chunk_data_length(chunk, MAX_TRNS_DATA_LENGTH);
+            result.has_transparency = true;
+        } else if (memcmp(chunk.type_code, "acTL", 4) == 0) {
+            check_chunk_data_length(chunk, ACTL_DATA_LENGTH);
+            result.is_animated = true;
+        }
+        skip_chunk_data(input, chunk, true);
     }
+    return result;
+}
+
+ProbeResult ProbePng(std::string_view filename, bool need_to_scan_chunks) {
+    // only the beginning of the file is needed, so it isn't mapped
+    std::ifstream file_input = open_png_file(filename);
+    return probe_png(file_input, need_to_scan_chunks);
+}
 
-    if (ihdr.bit_depth != 8 && ihdr.color_type != 3) {
-        auto cast_to_8_bits = [&](int val) {
-            return val * 0xff / ((1 << ihdr.bit_depth) - 1);
-        };
-        for (int row = 0; row < result.Height(); row++) {
-            for (int column = 0; column < result.Width(); column++) {
-                result(row, column).r = cast_to_8_bits(result(row, column).r);
-                result(row, column).g = cast_to_8_bits(result(row, column).g);
-                result(row, column).b = cast_to_8_bits(result(row, column).b);
-                result(row, column).a = cast_to_8_bits(result(row, column).a);
+ProbeResult ProbePng(std::span<const uint8_t> data, bool need_to_scan_chunks) {
+    MemoryInput input{data.data(), data.size()};
+    return probe_png(input, need_to_scan_chunks);
+}
+
+//================//
+//==DECODE BATCH==//
+//================//
+
+// hands out decoder contexts to the running tasks, so there are at most as many contexts
+// as tasks running at once and they are reused across files
+class DecoderContextPool {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<DecoderContext>> free_contexts;
+
+public:
+    std::unique_ptr<DecoderContext> acquire() {
+        {
+            std::lock_guard lock(mutex);
+            if (!free_contexts.empty()) {
+                std::unique_ptr<DecoderContext> context = std::move(free_contexts.back());
+                free_contexts.pop_back();
+                return context;
             }
         }
+        return std::make_unique<DecoderContext>();
     }
-    return result;
+
+    void release(std::unique_ptr<DecoderContext> context) {
+        std::lock_guard lock(mutex);
+        free_contexts.push_back(std::move(context));
+    }
+};
+
+void DecodeBatch(std::span<const std::string> filenames, ThreadPool &pool,
+                 const std::function<void(std::size_t index, DecodeResult &&result)> &callback,
+                 DecodeOptions options) {
+    DecoderContextPool contexts;
+    pool.parallel_for(filenames.size(), [&](std::size_t index) {
+        std::unique_ptr<DecoderContext> context = contexts.acquire();
+        DecodeResult result;
+        try {
+            result.image = read_png(filenames[index], *context, options);
+        } catch (...) {
+            result.error = std::current_exception();
+        }
+        contexts.release(std::move(context));
+        callback(index, std::move(result));
+    });
 }
 
-Image ReadPng(std::string_view filename) {
-    std::ifstream file_input(filename.data(), std::ios_base::in | std::ios_base::binary);
-    // сначала нужно проверить, что файл открыт
-    if (!file_input.is_open()) {
-        throw PNGDecoderException("Unable to open file \"" + std::string(filename) + "\"");
+std::vector<DecodeResult> DecodeBatch(std::span<const std::string> filenames, ThreadPool &pool, DecodeOptions options) {
+    std::vector<DecodeResult> results(filenames.size());
+    DecodeBatch(
+            filenames, pool, [&](std::size_t index, DecodeResult &&result) {
+                results[index] = std::move(result);
+            },
+            options);
+    return results;
+}
+
+std::vector<DecodeResult> DecodeBatch(std::span<const std::string> filenames, std::size_t thread_count,
+                                      DecodeOptions options) {
+    ThreadPool pool(thread_count);
+    return DecodeBatch(filenames, pool, options);
+}
+
+//==================//
+//==PNG ROW READER==//
+//==================//
+
+PNGRowReader::PNGRowReader(std::istream &input, DecodeLimits limits)
+    : reader(std::make_unique<ScanlineReader>(input, limits)), ihdr(reader->get_ihdr()) {
+    if (ihdr.interlace_method == 0) {
+        unpacker = std::make_unique<PixelUnpacker>(ihdr, reader->get_palette());
     }
-    // а уже потом ставить обработку исключений, иначе упадет
-    file_input.exceptions(std::ios_base::failbit | std::ios_base::badbit);
-    return PNGDecoder(file_input).build_image();
+}
+
+PNGRowReader::~PNGRowReader() = default;
+
+const IHDR &PNGRowReader::get_ihdr() const {
+    return ihdr;
+}
+
+std::size_t PNGRowReader::get_row_size() const {
+    return 4 * static_cast<std::size_t>(ihdr.width);
+}
+
+bool PNGRowReader::next_row(std::span<uint8_t> row_data) {
+    if (row_data.size() < get_row_size()) {
+        throw PNGDecoderException("call next_row(), row_data.size() = " + std::to_string(row_data.size()) +
+                                  ", less than " + std::to_string(get_row_size()));
+    }
+
+    if (ihdr.interlace_method == 0) {
+        if (!reader->next_scanline()) {
+            return false;
+        }
+        uint8_t *scanline = reader->get_scanline();
+        std::size_t bpp = (ihdr.get_pixel_len_in_bits() + 7) / 8;
+        remove_filter(scanline, reader->get_previous_scanline(), reader->get_row_len_in_bytes(), bpp);
+        unpacker->unpack(scanline + 1, ihdr.width, reinterpret_cast<RGB *>(row_data.data()));
+        return true;
+    }
+
+    // every row of interlaced image is finished only by the last passes
+    if (row == 0) {
+        interlaced_image = read_image(*reader);
+    }
+    if (row == ihdr.height) {
+        return false;
+    }
+    std::memcpy(row_data.data(), &interlaced_image(row, 0), get_row_size());
+    row++;
+    return true;
 }
@@ -1,10 +1,19 @@
 #pragma once
 
+#include "byte_buffer.hpp"
 #include "ihdr.hpp"
 #include "image.hpp"
+#include <array>
+#include <chrono>
 #include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <span>
 #include <stdexcept>
 #include <string>
+#include <tuple>
+#include <vector>
 
 struct PNGDecoderException : std::runtime_error {
     explicit PNGDecoderException(const std::string &message);
@@ -18,15 +27,252 @@ struct InvalidPNGFormatException : PNGDecoderException {
     explicit InvalidPNGFormatException(const std::string &message);
 };
 
+// a limit of DecodeOptions::limits is exceeded
+struct DecodeLimitException : PNGDecoderException {
+    explicit DecodeLimitException(const std::string &message);
+};
+
+class ThreadPool;
+
+// Bounds for untrusted inputs, so a small hostile file can't make the decoder allocate or work too much.
+// 0 means no limit. Every limit is checked as soon as its value is known: the sizes before allocating,
+// the deadline between chunks and between the decoding stages
+struct DecodeLimits {
+    std::uint64_t max_pixels = 0;
+    std::size_t max_decompressed_bytes = 0;// filtered scanlines, known from IHDR
+    std::size_t max_chunk_size = 0;
+    std::size_t max_chunk_count = 0;
+    std::size_t max_ancillary_bytes = 0;// total data length of tEXt, iCCP, ...
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+};
+
+enum class CrcCheckMode {
+    ALL,
+    CRITICAL_ONLY,// CRC of ancillary chunks (tEXt, gAMA, ...) is not checked
+    NONE,
+};
+
+// Validation can be relaxed only for trusted inputs, e.g. assets verified by an outer hash.
+// Default is full validation
+struct DecodeOptions {
+    CrcCheckMode crc_check_mode = CrcCheckMode::ALL;
+    bool need_to_check_adler32 = true;
+    // if set, large images are unfiltered on the pool
+    ThreadPool *thread_pool = nullptr;
+    DecodeLimits limits = {};
+};
+
+// what was validated and skipped during the decoding
+struct DecodeCounters {
+    std::size_t checked_crc_count = 0;
+    std::size_t skipped_crc_count = 0;
+    std::size_t skipped_adler32_count = 0;
+};
+
+#ifdef PNG_DECODER_STATS
+// Where the time of one decoding goes, collected only if the library is built with PNG_DECODER_STATS.
+// Times of the stages run on a thread pool are summed over the tasks
+struct DecodeStats {
+    std::uint64_t read_chunks_ns = 0;// including crc_ns
+    std::uint64_t crc_ns = 0;        // CRC checks of the chunks
+    std::uint64_t inflate_ns = 0;
+    std::uint64_t remove_filters_ns = 0;
+    std::uint64_t write_pixels_ns = 0;// unpacking, rescaling to 8 bits and deinterlacing
+
+    std::size_t input_bytes = 0;       // signature and all chunks
+    std::size_t compressed_bytes = 0;  // IDAT payloads
+    std::size_t decompressed_bytes = 0;// filtered scanlines
+    std::size_t output_bytes = 0;      // written by decode_into()
+
+    std::size_t chunk_count = 0;
+    std::size_t idat_chunk_count = 0;
+    std::size_t ancillary_chunk_count = 0;
+
+    // rows per filter type: None, Sub, Up, Average, Paeth
+    std::array<std::size_t, 5> filter_type_counts{};
+
+    // buffers of the decoder context that had to grow
+    std::size_t buffer_allocation_count = 0;
+};
+#endif
+
+// The filter mix of an inflated image and the predicted time of its decode_into(),
+// e.g. to send Paeth-heavy images to a separate pool. It is known only after the constructor
+// has inflated the data, so it can't be used to skip inflating
+struct DecodeCost {
+    // rows and their bytes (without the filter type byte) per filter type: None, Sub, Up, Average, Paeth
+    std::array<std::size_t, 5> filter_type_counts{};
+    std::array<std::size_t, 5> filter_type_bytes{};
+    std::size_t pixel_count = 0;
+    // of unfiltering and unpacking on one thread, by the speeds measured with bench_png_decoder on one machine,
+    // so it is only comparable between images; callers can calibrate their own speeds on filter_type_bytes
+    double predicted_ns = 0;
+};
+
+// layout of one pixel in the output buffer of decode_into()
+enum class PixelFormat {
+    RGBA8,
+    BGRA8,
+    RGB8,
+    // 16 bits per channel in the native byte order, every sample of a lower bit depth is scaled to 0..65535,
+    // dst and stride should be even for the fastest path
+    RGBA16,
+    GRAY16,// only for grayscale images (color type 0 or 4), alpha is dropped
+};
+
+// bytes per pixel
+std::size_t get_pixel_size(PixelFormat format);
+
+class DeflateWrapper;
+
+// Long-lived state for many decodes: the libdeflate decompressor and grow-only buffers.
+// Once the buffers have grown, decoding with decode_into() allocates nothing.
+// A context serves one decoder at a time, so use one per thread
+class DecoderContext {
+    std::unique_ptr<DeflateWrapper> deflate_wrapper;
+    std::string data_accum;
+    std::string chunk_buffer;
+    ByteBuffer pixels_data;
+    std::string palette;
+    // scratch rows for the 8-bit and the 16-bit formats, one per Adam7 pass if the passes are decoded in parallel
+    std::tuple<std::vector<RGB>, std::vector<RGB16>> pixels;
+
+    friend class PNGDecoder;
+
+#ifdef PNG_DECODER_STATS
+    // to count the buffers grown by a decoding
+    std::array<std::size_t, 6> get_capacities() const;
+#endif
+
+public:
+    DecoderContext();
+
+    ~DecoderContext();
+};
+
 class PNGDecoder {
+    std::unique_ptr<DecoderContext> own_context;// if the caller gives no context
+    DecoderContext *context;
     IHDR ihdr;
-    std::string pixels_data;
-    std::string palette;
+    bool is_filters_removed = false;
+    // unfiltering threw partway, the pixels data is neither filtered nor unfiltered
+    bool is_failed = false;
+    DecodeOptions options;
+    DecodeCounters counters;
+#ifdef PNG_DECODER_STATS
+    DecodeStats stats;
+#endif
+
+    template<typename Input>
+    void read_chunks(Input &input);
+
+    void remove_all_filters();
+
+    template<typename Unpacker>
+    void decode_passes(const Unpacker &unpacker, uint8_t *dst, std::size_t stride, PixelFormat format);
 
 public:
-    PNGDecoder(std::istream &input);
+    PNGDecoder(std::istream &input, DecodeOptions options = {});
+
+    // data is the whole PNG file, chunks are parsed in place
+    explicit PNGDecoder(std::span<const uint8_t> data, DecodeOptions options = {});
+
+    // the decoder keeps its data in the context, so the context must outlive it
+    // and must not be given to another decoder until this one is done
+    PNGDecoder(std::istream &input, DecoderContext &context, DecodeOptions options = {});
+
+    PNGDecoder(std::span<const uint8_t> data, DecoderContext &context, DecodeOptions options = {});
+
+    const IHDR &get_ihdr() const;
+
+    const DecodeCounters &get_counters() const;
+
+    // scans the filter type bytes of the inflated data, cheap compared to decode_into()
+    DecodeCost get_decode_cost() const;
+
+#ifdef PNG_DECODER_STATS
+    const DecodeStats &get_stats() const;
+#endif
+
+    // decodes the image into the caller's buffer: row r starts at dst + r * stride,
+    // stride must be at least width * get_pixel_size(format)
+    void decode_into(uint8_t *dst, std::size_t stride, PixelFormat format);
 
     Image build_image();
+
+    // 16 bits per channel, without losing the precision of 16-bit images
+    Image16 build_image16();
 };
 
-Image ReadPng(std::string_view filename);
\ No newline at end of file
+class ScanlineReader;
+template <typename Pixel>
+class BasicPixelUnpacker;
+
+// Pull API: yields unfiltered rows of the image one at a time in 8-bit RGBA format.
+// Non-interlaced images are decoded keeping only two scanlines in memory,
+// interlaced ones are decoded entirely at the first call, since every row is finished only by the last passes
+class PNGRowReader {
+    std::unique_ptr<ScanlineReader> reader;
+    IHDR ihdr;
+    std::unique_ptr<BasicPixelUnpacker<RGB>> unpacker;
+    std::size_t row = 0;
+    Image interlaced_image;
+
+public:
+    // only limits apply to the streaming decoder, CRC and Adler-32 are always checked
+    explicit PNGRowReader(std::istream &input, DecodeLimits limits = {});
+
+    ~PNGRowReader();
+
+    const IHDR &get_ihdr() const;
+
+    // 4 * width bytes
+    std::size_t get_row_size() const;
+
+    // writes the next row into row_data[0, get_row_size()), returns false after the last row
+    bool next_row(std::span<uint8_t> row_data);
+};
+
+// the file is memory-mapped if possible, otherwise it is read through std::ifstream
+Image ReadPng(std::string_view filename, DecodeOptions options = {});
+
+// like ReadPng, but with 16 bits per channel
+Image16 ReadPng16(std::string_view filename, DecodeOptions options = {});
+
+// inflates and unfilters the image scanline by scanline while reading the file,
+// without keeping the compressed and the filtered data in memory
+Image ReadPngStreaming(std::string_view filename, DecodeLimits limits = {});
+
+// what is known about the image without decoding it
+struct ProbeResult {
+    IHDR ihdr;
+    // set only if the chunks are scanned
+    bool has_palette = false;     // PLTE
+    bool has_transparency = false;// tRNS
+    bool is_animated = false;     // acTL of APNG
+};
+
+// Validates the signature and reads IHDR, which must be the first chunk.
+// If need_to_scan_chunks, also reads the chunks before the first IDAT, without touching the image data
+ProbeResult ProbePng(std::string_view filename, bool need_to_scan_chunks = false);
+
+ProbeResult ProbePng(std::span<const uint8_t> data, bool need_to_scan_chunks = false);
+
+struct DecodeResult {
+    Image image;
+    std::exception_ptr error;// set if the file failed to decode, then the image is empty
+};
+
+// Decodes the files like ReadPng on the pool, every running task reuses a DecoderContext.
+// callback(index, result) is called from the pool threads as soon as filenames[index] is decoded, in any order
+void DecodeBatch(std::span<const std::string> filenames, ThreadPool &pool,
+                 const std::function<void(std::size_t index, DecodeResult &&result)> &callback,
+                 DecodeOptions options = {});
+
+// results are in the order of filenames
+std::vector<DecodeResult> DecodeBatch(std::span<const std::string> filenames, ThreadPool &pool,
+                                      DecodeOptions options = {});
+
+// creates a pool of thread_count threads for the batch, 0 means std::thread::hardware_concurrency()
+std::vector<DecodeResult> DecodeBatch(std::span<const std::string> filenames, std::size_t thread_count = 0,
+                                      DecodeOptions options = {});
\ No newline at end of file
@@ -0,0 +1,208 @@
+#include "scanline_reader.hpp"
+#include "decode_limits.hpp"
+#include "interlace.hpp"
+#include <algorithm>
+#include <cstring>
+
+const std::size_t STREAM_INPUT_BUFFER_SIZE = 1 << 15;
+
+ScanlineReader::ScanlineReader(std::istream &input_, DecodeLimits limits_) : input(input_), limits(limits_) {
+    input_buffer.resize(STREAM_INPUT_BUFFER_SIZE);
+    read_signature(input);
+
+    bool is_read_ihdr = false;
+    bool is_read_palette = false;
+    while (true) {
+        ChunkHeader chunk = read_limited_chunk_header();
+        if (memcmp(chunk.type_code, "IDAT", 4) == 0) {
+            idat_left = chunk.data_length;
+            idat_crc.add_bytes(chunk.type_code, 4);
+            break;
+        }
+
+        // only IHDR and PLTE are kept, they are small,
+        // other chunks (iCCP, zTXt, ...) are skipped through input_buffer
+        if (memcmp(chunk.type_code, "IHDR", 4) == 0) {
+            check_chunk_data_length(chunk, IHDR_DATA_LENGTH);
+            std::string chunk_data(chunk.data_length, '\0');
+            read_chunk_data(input, chunk, chunk_data.data(), true);
+            is_read_ihdr = true;
+            ihdr.read(chunk_data);
+            check_image_limits(ihdr, limits);
+        } else if (memcmp(chunk.type_code, "PLTE", 4) == 0) {
+            check_chunk_data_length(chunk, MAX_PLTE_DATA_LENGTH - palette.size());
+            std::size_t offset = palette.size();
+            palette.resize(offset + chunk.data_length);
+            read_chunk_data(input, chunk, palette.data() + offset, true);
+            is_read_palette = true;
+        } else {
+            CrcCalculator crc;
+            crc.add_bytes(chunk.type_code, 4);
+            skip_chunk_data(chunk.data_length, crc);
+            if (memcmp(chunk.type_code, "IEND", 4) == 0) {
+                throw InvalidPNGFormatException("missing chunk \"IDAT\"");
+            }
+        }
+    }
+
+    if (!is_read_ihdr) {
+        throw InvalidPNGFormatException("missing chunk \"IHDR\"");
+    }
+
+    if (!is_read_palette && ihdr.color_type == 3) {
+        throw InvalidPNGFormatException("missing chunk \"PLTE\", but palette is used");
+    }
+
+    if (ihdr.interlace_method == 0) {
+        pass_cnt = -1;
+        last_pass_cnt = 0;
+    } else {
+        pass_cnt = 0;
+        last_pass_cnt = 7;
+    }
+
+    // the widest pass is the whole image width
+    std::size_t max_row_len_in_bytes = (ihdr.get_pixel_len_in_bits() * ihdr.width + 7) / 8;
+    scanline.resize(max_row_len_in_bytes + 1);
+    previous_scanline.resize(max_row_len_in_bytes + 1);
+}
+
+const IHDR &ScanlineReader::get_ihdr() const {
+    return ihdr;
+}
+
+const std::string &ScanlineReader::get_palette() const {
+    return palette;
+}
+
+ChunkHeader ScanlineReader::read_limited_chunk_header() {
+    ChunkHeader chunk = read_chunk_header(input);
+    check_chunk_limits(chunk, limits, chunk_count, ancillary_bytes);
+    return chunk;
+}
+
+void ScanlineReader::skip_chunk_data(uint32_t data_length, CrcCalculator crc) {
+    while (data_length > 0) {
+        std::size_t part = std::min<std::size_t>(data_length, input_buffer.size());
+        read_bytes(input, input_buffer.data(), part, read_context_t::CHUNK_DATA, false);
+        crc.add_bytes(input_buffer.data(), part);
+        data_length -= part;
+    }
+
+    uint32_t actual_crc;
+    read_bytes(input, &actual_crc, 4, read_context_t::CHUNK_CRC, true);
+    check_chunk_crc(actual_crc, crc.get_checksum());
+}
+
+void ScanlineReader::fill_input() {
+    while (idat_left == 0) {
+        // current IDAT is over, the next one must follow it
+        skip_chunk_data(0, idat_crc);
+
+        ChunkHeader chunk = read_limited_chunk_header();
+        if (memcmp(chunk.type_code, "IDAT", 4) != 0) {
+            throw InvalidPNGFormatException("short pixel data length");
+        }
+        idat_left = chunk.data_length;
+        idat_crc.reset();
+        idat_crc.add_bytes(chunk.type_code, 4);
+    }
+
+    check_deadline(limits);
+    std::size_t part = std::min<std::size_t>(idat_left, input_buffer.size());
+    read_bytes(input, input_buffer.data(), part, read_context_t::CHUNK_DATA, false);
+    idat_crc.add_bytes(input_buffer.data(), part);
+    idat_left -= part;
+    inflate_stream.set_input(input_buffer.data(), part);
+}
+
+void ScanlineReader::inflate_exactly(char *out, std::size_t size) {
+    while (size > 0) {
+        if (inflate_stream.is_finished()) {
+            throw InvalidPNGFormatException("short pixel data length");
+        }
+        if (inflate_stream.need_input()) {
+            fill_input();
+        }
+        std::size_t written = inflate_stream.inflate(out, size);
+        out += written;
+        size -= written;
+    }
+}
+
+void ScanlineReader::read_tail() {
+    // zlib stream must end right after the last scanline
+    while (!inflate_stream.is_finished()) {
+        if (inflate_stream.need_input()) {
+            fill_input();
+        }
+        char extra_byte;
+        if (inflate_stream.inflate(&extra_byte, 1) != 0) {
+            throw InvalidPNGFormatException("too much length pixel data");
+        }
+    }
+    skip_chunk_data(idat_left, idat_crc);
+    idat_left = 0;
+
+    while (true) {
+        ChunkHeader chunk = read_limited_chunk_header();
+        CrcCalculator crc;
+        crc.add_bytes(chunk.type_code, 4);
+        skip_chunk_data(chunk.data_length, crc);
+        if (memcmp(chunk.type_code, "IEND", 4) == 0) {
+            break;
+        }
+    }
+}
+
+bool ScanlineReader::next_scanline() {
+    if (is_finished) {
+        return false;
+    }
+
+    row++;
+    while (row >= pass_height) {
+        if (pass_cnt == last_pass_cnt) {
+            read_tail();
+            is_finished = true;
+            return false;
+        }
+        pass_cnt++;
+        auto [height, width_] = get_subimage_shape_in_interlace(pass_cnt, ihdr.height, ihdr.width);
+        pass_height = width_ == 0 ? 0 : height;// empty pass is not stored at all
+        width = width_;
+        row_len_in_bytes = (ihdr.get_pixel_len_in_bits() * width + 7) / 8;
+        row = 0;
+    }
+
+    std::swap(scanline, previous_scanline);
+    inflate_exactly(scanline.data(), row_len_in_bytes + 1);
+    return true;
+}
+
+uint8_t *ScanlineReader::get_scanline() {
+    return reinterpret_cast<uint8_t *>(scanline.data());
+}
+
+const uint8_t *ScanlineReader::get_previous_scanline() const {
+    if (row == 0) {
+        return nullptr;
+    }
+    return reinterpret_cast<const uint8_t *>(previous_scanline.data());
+}
+
+int ScanlineReader::get_pass() const {
+    return pass_cnt;
+}
+
+std::size_t ScanlineReader::get_row() const {
+    return row;
+}
+
+std::size_t ScanlineReader::get_width() const {
+    return width;
+}
+
+std::size_t ScanlineReader::get_row_len_in_bytes() const {
+    return row_len_in_bytes;
+}
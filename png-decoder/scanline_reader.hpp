@@ -0,0 +1,78 @@
+#pragma once
+
+#include "chunk_reader.hpp"
+#include "crc_calculator.hpp"
+#include "deflate_wrappers.hpp"
+#include "ihdr.hpp"
+#include "png_decoder.hpp"
+#include <istream>
+#include <string>
+
+// Reads PNG from the stream and inflates IDAT chunks as they arrive.
+// Only the current and the previous scanline are kept in memory,
+// so the compressed and the filtered image are never stored entirely.
+// Of the other chunks only IHDR and PLTE are kept, the rest are skipped.
+class ScanlineReader {
+    std::istream &input;
+    DecodeLimits limits;
+    std::size_t chunk_count = 0;
+    std::size_t ancillary_bytes = 0;
+    IHDR ihdr;
+    std::string palette;
+
+    InflateStreamWrapper inflate_stream;
+    std::string input_buffer;
+    uint32_t idat_left = 0;// unread bytes of the current IDAT chunk
+    CrcCalculator idat_crc;// CRC of the current IDAT chunk read so far
+
+    int pass_cnt;
+    int last_pass_cnt;
+    std::size_t pass_height = 0;
+    std::size_t width = 0;
+    std::size_t row = 0;
+    std::size_t row_len_in_bytes = 0;
+    bool is_finished = false;
+
+    std::string scanline;
+    std::string previous_scanline;
+
+    ChunkHeader read_limited_chunk_header();
+
+    void skip_chunk_data(uint32_t data_length, CrcCalculator crc);
+
+    void fill_input();
+
+    void inflate_exactly(char *out, std::size_t size);
+
+    void read_tail();
+
+public:
+    // reads chunks up to the first IDAT, limits are checked for every chunk and every part of IDAT
+    explicit ScanlineReader(std::istream &input, DecodeLimits limits = {});
+
+    const IHDR &get_ihdr() const;
+
+    const std::string &get_palette() const;
+
+    // inflates the next filtered scanline, returns false after the last one,
+    // when all remaining chunks up to IEND are read and validated
+    bool next_scanline();
+
+    // filter type byte followed by get_row_len_in_bytes() bytes,
+    // can be unfiltered in place
+    uint8_t *get_scanline();
+
+    // the previous scanline of the same pass or nullptr for the first row of the pass
+    const uint8_t *get_previous_scanline() const;
+
+    // 0 for non-interlaced image, 1-7 for Adam7 passes
+    int get_pass() const;
+
+    // row of the scanline in the pass subimage
+    std::size_t get_row() const;
+
+    // width of the pass subimage in pixels
+    std::size_t get_width() const;
+
+    std::size_t get_row_len_in_bytes() const;
+};
@@ -0,0 +1,167 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <exception>
+
+struct ThreadPool::Batch {
+    const std::function<void(std::size_t index)> *function;
+    std::atomic<std::size_t> left;// changed under the mutex, read without it only as a hint
+
+    std::mutex mutex;
+    std::condition_variable done;
+    std::exception_ptr error;
+};
+
+namespace {
+    // the pool and the worker index of the current thread, if it is a pool worker
+    thread_local const void *current_pool = nullptr;
+    thread_local std::size_t current_worker_index = 0;
+}// namespace
+
+ThreadPool::ThreadPool(std::size_t thread_count) {
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (std::size_t index = 0; index < thread_count; index++) {
+        queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (std::size_t index = 0; index < thread_count; index++) {
+        threads.emplace_back([this, index] { worker_loop(index); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(sleep_mutex);
+        is_stopping = true;
+    }
+    wake_up.notify_all();
+    for (auto &thread: threads) {
+        thread.join();
+    }
+}
+
+std::size_t ThreadPool::get_thread_count() const {
+    return threads.size();
+}
+
+bool ThreadPool::try_pop(std::size_t queue_index, const Batch *batch, Task &task) {
+    WorkerQueue &queue = *queues[queue_index];
+    std::lock_guard lock(queue.mutex);
+    for (auto it = queue.tasks.rbegin(); it != queue.tasks.rend(); it++) {
+        if (batch == nullptr || it->batch == batch) {
+            task = *it;
+            queue.tasks.erase(std::next(it).base());
+            queued_count--;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::try_steal(std::size_t queue_index, const Batch *batch, Task &task) {
+    WorkerQueue &queue = *queues[queue_index];
+    std::lock_guard lock(queue.mutex);
+    for (auto it = queue.tasks.begin(); it != queue.tasks.end(); it++) {
+        if (batch == nullptr || it->batch == batch) {
+            task = *it;
+            queue.tasks.erase(it);
+            queued_count--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(Task task) {
+    Batch &batch = *task.batch;
+    std::exception_ptr error;
+    try {
+        (*batch.function)(task.index);
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    // the waiter destroys the batch right after the last task is counted,
+    // so counting under the lock is the last access to it
+    std::lock_guard lock(batch.mutex);
+    if (error && !batch.error) {
+        batch.error = error;
+    }
+    if (--batch.left == 0) {
+        batch.done.notify_all();
+    }
+}
+
+void ThreadPool::worker_loop(std::size_t worker_index) {
+    current_pool = this;
+    current_worker_index = worker_index;
+
+    while (true) {
+        Task task;
+        bool is_found = try_pop(worker_index, nullptr, task);
+        for (std::size_t shift = 1; !is_found && shift < queues.size(); shift++) {
+            is_found = try_steal((worker_index + shift) % queues.size(), nullptr, task);
+        }
+        if (is_found) {
+            run(task);
+            continue;
+        }
+
+        std::unique_lock lock(sleep_mutex);
+        wake_up.wait(lock, [this] { return is_stopping || queued_count > 0; });
+        if (is_stopping && queued_count == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::parallel_for(std::size_t count, const std::function<void(std::size_t index)> &task) {
+    if (count == 0) {
+        return;
+    }
+
+    Batch batch;
+    batch.function = &task;
+    batch.left = count;
+
+    bool is_worker = current_pool == this;
+    {
+        std::lock_guard sleep_lock(sleep_mutex);
+        if (is_worker) {
+            // the other workers steal them
+            WorkerQueue &queue = *queues[current_worker_index];
+            std::lock_guard lock(queue.mutex);
+            for (std::size_t index = 0; index < count; index++) {
+                queue.tasks.push_back({&batch, index});
+            }
+        } else {
+            for (std::size_t index = 0; index < count; index++) {
+                WorkerQueue &queue = *queues[index % queues.size()];
+                std::lock_guard lock(queue.mutex);
+                queue.tasks.push_back({&batch, index});
+            }
+        }
+        queued_count += count;
+    }
+    wake_up.notify_all();
+
+    // help with the tasks of this batch only: the caller may hold resources the other batches need
+    while (batch.left > 0) {
+        Task own_task;
+        bool is_found = is_worker && try_pop(current_worker_index, &batch, own_task);
+        for (std::size_t index = 0; !is_found && index < queues.size(); index++) {
+            is_found = try_steal(index, &batch, own_task);
+        }
+        if (!is_found) {
+            // the rest of the batch is already running on other threads
+            break;
+        }
+        run(own_task);
+    }
+
+    std::unique_lock lock(batch.mutex);
+    batch.done.wait(lock, [&batch] { return batch.left == 0; });
+    if (batch.error) {
+        std::rethrow_exception(batch.error);
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool: every worker has its own task deque, takes its tasks from the back
+// and steals from the front of the others' deques when it runs out.
+// parallel_for can be called from any thread, also from the tasks of this pool
+class ThreadPool {
+    struct Batch;
+
+    struct Task {
+        Batch *batch;
+        std::size_t index;
+    };
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex sleep_mutex;
+    std::condition_variable wake_up;
+    std::atomic<std::size_t> queued_count = 0;
+    bool is_stopping = false;
+
+    // batch == nullptr takes a task of any batch
+    bool try_pop(std::size_t queue_index, const Batch *batch, Task &task);
+
+    bool try_steal(std::size_t queue_index, const Batch *batch, Task &task);
+
+    void run(Task task);
+
+    void worker_loop(std::size_t worker_index);
+
+public:
+    // 0 threads means std::thread::hardware_concurrency()
+    explicit ThreadPool(std::size_t thread_count = 0);
+
+    // finishes the queued tasks
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &other) = delete;
+
+    ThreadPool(ThreadPool &&other) = delete;
+
+    ThreadPool &operator=(const ThreadPool &other) = delete;
+
+    ThreadPool &operator=(ThreadPool &&other) = delete;
+
+    std::size_t get_thread_count() const;
+
+    // runs task(index) for every index in [0, count) and waits for all of them.
+    // The calling thread helps with the tasks of this call while waiting.
+    // If tasks throw, the first exception is rethrown after all tasks are finished
+    void parallel_for(std::size_t count, const std::function<void(std::size_t index)> &task);
+};
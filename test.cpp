@@ -57,6 +57,200 @@ TEST_CASE("white1") {
     CheckImage("small1.png", "out.png");
 }
 
+TEST_CASE("wrong_pixel_data_length") {
+    CHECK_THROWS(CheckImage("short_idat.png"));
+    CHECK_THROWS(CheckImage("long_idat.png"));
+}
+
+const std::vector<std::string> kValidImages = {
+        "logo.png", "lenna_grayscale.png", "lenna_index.png", "logo_alpha.png",
+        "1.png", "inter.png", "alpha_grayscale.png", "smile_plte.png",
+        "bulletproof.png", "bulletproof_64.png", "bulletproof_mono.png",
+        "white1.png", "my_bw.png", "my1.png", "small1.png"};
+
+TEST_CASE("istream") {
+    for (const auto &filename: kValidImages) {
+        CheckImageIstream(filename);
+    }
+    CHECK_THROWS(CheckImageIstream("crc.png"));
+    CHECK_THROWS(CheckImageIstream("short_idat.png"));
+    CHECK_THROWS(CheckImageIstream("long_idat.png"));
+}
+
+TEST_CASE("span") {
+    for (const auto &filename: kValidImages) {
+        CheckImageSpan(filename);
+    }
+    CHECK_THROWS(CheckImageSpan("crc.png"));
+    CHECK_THROWS(CheckImageSpan("short_idat.png"));
+    CHECK_THROWS(CheckImageSpan("long_idat.png"));
+
+    std::vector<uint8_t> bytes = ReadFileBytes("logo.png");
+    for (std::size_t size = 0; size < bytes.size(); size++) {
+        CHECK_THROWS_AS(PNGDecoder(std::span<const uint8_t>(bytes.data(), size)), PNGDecoderException);
+    }
+}
+
+TEST_CASE("inflate_expansion") {
+    // 20000 x 20000 RGBA pixels from 5 bytes of IDAT, rejected before allocating 1.6 GB
+    std::string ihdr = {0, 0, 0x4e, 0x20, 0, 0, 0x4e, 0x20, 8, 6, 0, 0, 0};
+    std::vector<uint8_t> bytes = MakePng({{"IHDR", ihdr}, {"IDAT", "\x78\x9c\x03\x00\x00"}, {"IEND", ""}});
+    CHECK_THROWS_AS(PNGDecoder(std::span<const uint8_t>(bytes)), DeflateWrapperException);
+    CHECK_THROWS_AS(PNGDecoder(std::span<const uint8_t>(bytes), {.need_to_check_adler32 = false}),
+                    DeflateWrapperException);
+}
+
+TEST_CASE("failed_decode") {
+    // 2x2 grayscale in a stored deflate block, the second row has filter mode 5
+    std::string ihdr = {0, 0, 0, 2, 0, 0, 0, 2, 8, 0, 0, 0, 0};
+    std::string idat = {0x78, 0x01, 0x01, 0x06, 0x00, '\xf9', '\xff', 1, 1, 2, 5, 3, 4, 0, 0, 0, 0};
+    std::vector<uint8_t> bytes = MakePng({{"IHDR", ihdr}, {"IDAT", idat}, {"IEND", ""}});
+    PNGDecoder decoder(std::span<const uint8_t>(bytes), {.need_to_check_adler32 = false});
+    CHECK_THROWS_AS(decoder.build_image(), InvalidPNGFormatException);
+    // the first row is already unfiltered, it must not be unfiltered again
+    CHECK_THROWS_WITH(decoder.build_image(), Catch::Contains("after a failed one"));
+}
+
+TEST_CASE("decoder_context") {
+    CheckDecoderContext(kValidImages);
+}
+
+TEST_CASE("decode_options") {
+    CheckDecodeOptions();
+}
+
+TEST_CASE("probe") {
+    for (const auto &filename: kValidImages) {
+        CheckProbe(filename);
+    }
+    CHECK_THROWS(ProbePng(kBasePath + "tests/not_found1273612536asduashydgwayd.png"));
+    std::vector<uint8_t> bytes = ReadFileBytes("logo.png");
+    bytes[0] ^= 1;
+    CHECK_THROWS_AS(ProbePng(std::span<const uint8_t>(bytes)), InvalidPNGFormatException);
+    CheckProbeLongChunks();
+}
+
+TEST_CASE("decode_cost") {
+    for (const auto &filename: kValidImages) {
+        CheckDecodeCost(filename);
+    }
+}
+
+#ifdef PNG_DECODER_STATS
+TEST_CASE("decode_stats") {
+    ThreadPool pool(4);
+    for (const auto &filename: kValidImages) {
+        CheckDecodeStats(filename);
+        CheckDecodeStats(filename, &pool);
+    }
+}
+#endif
+
+TEST_CASE("decode_limits") {
+    CheckDecodeLimits();
+}
+
+TEST_CASE("concurrent") {
+    CheckConcurrentDecode(kValidImages, 4);
+}
+
+TEST_CASE("thread_pool") {
+    CheckThreadPool(1);
+    CheckThreadPool(4);
+}
+
+TEST_CASE("decode_batch") {
+    CheckDecodeBatch(kValidImages);
+}
+
+TEST_CASE("streaming") {
+    for (const auto &filename: kValidImages) {
+        CheckImageStreaming(filename);
+    }
+    CHECK_THROWS(CheckImageStreaming("crc.png"));
+    CHECK_THROWS(CheckImageStreaming("short_idat.png"));
+    CHECK_THROWS(CheckImageStreaming("long_idat.png"));
+}
+
+TEST_CASE("row_reader") {
+    for (const auto &filename: kValidImages) {
+        CheckRowReader(filename);
+    }
+    CheckStreamingChunks();
+}
+
+TEST_CASE("decode_into") {
+    for (const auto &filename: kValidImages) {
+        for (PixelFormat format: {PixelFormat::RGBA8, PixelFormat::BGRA8, PixelFormat::RGB8}) {
+            CheckDecodeInto(filename, format);
+        }
+    }
+}
+
+TEST_CASE("filters") {
+    for (uint8_t filter_type = 0; filter_type <= 4; filter_type++) {
+        CheckFilter(filter_type);
+    }
+}
+
+TEST_CASE("parallel_filters") {
+    CheckParallelFilters();
+
+    ThreadPool pool(4);
+    for (const auto &filename: kValidImages) {
+        CheckImageThreadPool(filename, pool);
+    }
+}
+
+TEST_CASE("parallel_interlace") {
+    ThreadPool pool(4);
+    for (const auto &filename: {"inter.png", "alpha_grayscale.png"}) {
+        for (PixelFormat format: {PixelFormat::RGBA8, PixelFormat::BGRA8, PixelFormat::RGB8}) {
+            CheckDecodeInto(filename, format, &pool);
+        }
+    }
+}
+
+TEST_CASE("output_16_bits") {
+    ThreadPool pool(4);
+    for (const auto &filename: kValidImages) {
+        CheckImage16(filename);
+        CheckDecodeInto16(filename, PixelFormat::RGBA16);
+    }
+    CheckDecodeInto16("inter.png", PixelFormat::RGBA16, &pool);
+    for (const auto &filename: {"lenna_grayscale.png", "alpha_grayscale.png"}) {
+        CheckDecodeInto16(filename, PixelFormat::GRAY16);
+        CheckDecodeInto16(filename, PixelFormat::GRAY16, &pool);
+    }
+    std::vector<uint8_t> bytes = ReadFileBytes("logo.png");
+    std::vector<uint8_t> buffer(88 * 88 * 2);
+    CHECK_THROWS_AS(PNGDecoder(std::span<const uint8_t>(bytes)).decode_into(buffer.data(), 88 * 2, PixelFormat::GRAY16),
+                    PNGDecoderException);
+}
+
+TEST_CASE("unpacker") {
+    for (uint8_t bit_depth: {1, 2, 4, 8, 16}) {
+        CheckUnpacker(0, bit_depth);
+        if (bit_depth <= 8) {
+            CheckUnpacker(3, bit_depth);
+        }
+        if (bit_depth >= 8) {
+            CheckUnpacker(2, bit_depth);
+            CheckUnpacker(4, bit_depth);
+            CheckUnpacker(6, bit_depth);
+        }
+        CheckUnpacker<RGB16>(0, bit_depth);
+        if (bit_depth <= 8) {
+            CheckUnpacker<RGB16>(3, bit_depth);
+        }
+        if (bit_depth >= 8) {
+            CheckUnpacker<RGB16>(2, bit_depth);
+            CheckUnpacker<RGB16>(4, bit_depth);
+            CheckUnpacker<RGB16>(6, bit_depth);
+        }
+    }
+}
+
 TEST_CASE("unable_to_open") {
     CHECK_THROWS(CheckImage("not_found1273612536asduashydgwayd.png"));
 }
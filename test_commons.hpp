@@ -2,14 +2,27 @@
 
 #include <catch.hpp>
 
+#include <atomic>
 #include <cmath>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <optional>
+#include <random>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <type_traits>
 
+#include "png-decoder/crc_calculator.hpp"
+#include "png-decoder/deflate_wrappers.hpp"
+#include "png-decoder/filters.hpp"
 #include "png-decoder/image.hpp"
+#include "png-decoder/interlace.hpp"
 #include "png-decoder/libpng_wrappers.hpp"
+#include "png-decoder/pixel_unpacker.hpp"
 #include "png-decoder/png_decoder.hpp"
+#include "png-decoder/thread_pool.hpp"
 
 #ifndef TASK_DIR
 #define TASK_DIR "."
@@ -45,3 +58,748 @@ void CheckImage(
     auto ok_image = libpng::ReadImage(kBasePath + "tests/" + filename);
     Compare(image, ok_image);
 }
+
+// ReadPng maps the file into memory, this one goes through std::istream
+void CheckImageIstream(const std::string &filename) {
+    std::cerr << "Running istream " << filename << "\n";
+    std::ifstream input(kBasePath + "tests/" + filename, std::ios_base::in | std::ios_base::binary);
+    REQUIRE(input.is_open());
+    auto image = PNGDecoder(input).build_image();
+    auto ok_image = libpng::ReadImage(kBasePath + "tests/" + filename);
+    Compare(image, ok_image);
+}
+
+std::vector<uint8_t> ReadFileBytes(const std::string &filename) {
+    std::ifstream input(kBasePath + "tests/" + filename, std::ios_base::in | std::ios_base::binary);
+    REQUIRE(input.is_open());
+    return {std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()};
+}
+
+void CheckImageSpan(const std::string &filename) {
+    std::cerr << "Running span " << filename << "\n";
+    std::vector<uint8_t> bytes = ReadFileBytes(filename);
+    auto image = PNGDecoder(std::span<const uint8_t>(bytes)).build_image();
+    auto ok_image = libpng::ReadImage(kBasePath + "tests/" + filename);
+    Compare(image, ok_image);
+}
+
+// decodes the images from several threads at once, every result must match the libpng one
+void CheckConcurrentDecode(const std::vector<std::string> &filenames, int thread_count) {
+    std::cerr << "Running concurrent decode\n";
+    std::vector<Image> ok_images;
+    for (const auto &filename: filenames) {
+        ok_images.push_back(libpng::ReadImage(kBasePath + "tests/" + filename));
+    }
+
+    // catch assertions are not thread-safe, so threads only count the mismatches
+    std::atomic<int> mismatch_count = 0;
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < thread_count; thread++) {
+        threads.emplace_back([&, thread] {
+            for (std::size_t i = 0; i < filenames.size(); i++) {
+                std::size_t index = (i + thread) % filenames.size();
+                Image image;
+                try {
+                    image = ReadPng(kBasePath + "tests/" + filenames[index]);
+                } catch (const std::exception &) {
+                    mismatch_count++;
+                    continue;
+                }
+                const auto &ok_image = ok_images[index];
+                bool is_equal = image.Width() == ok_image.Width() && image.Height() == ok_image.Height();
+                for (int y = 0; is_equal && y < image.Height(); ++y) {
+                    for (int x = 0; is_equal && x < image.Width(); ++x) {
+                        is_equal = image(y, x) == ok_image(y, x);
+                    }
+                }
+                if (!is_equal) {
+                    mismatch_count++;
+                }
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    REQUIRE(mismatch_count == 0);
+}
+
+// one context is reused for all the images, also after failed decodes
+void CheckDecoderContext(const std::vector<std::string> &filenames) {
+    std::cerr << "Running decoder context\n";
+    DecoderContext context;
+    for (int round = 0; round < 2; round++) {
+        for (const auto &filename: filenames) {
+            auto ok_image = libpng::ReadImage(kBasePath + "tests/" + filename);
+            std::vector<uint8_t> bytes = ReadFileBytes(filename);
+            Compare(PNGDecoder(std::span<const uint8_t>(bytes), context).build_image(), ok_image);
+
+            std::ifstream input(kBasePath + "tests/" + filename, std::ios_base::in | std::ios_base::binary);
+            REQUIRE(input.is_open());
+            Compare(PNGDecoder(input, context).build_image(), ok_image);
+
+            std::vector<uint8_t> bad_bytes = ReadFileBytes("crc.png");
+            CHECK_THROWS(PNGDecoder(std::span<const uint8_t>(bad_bytes), context));
+        }
+    }
+}
+
+uint32_t GetChunkDataLength(const std::vector<uint8_t> &bytes, std::size_t offset) {
+    return (bytes[offset] << 24) | (bytes[offset + 1] << 16) | (bytes[offset + 2] << 8) | bytes[offset + 3];
+}
+
+// offset of the first chunk of the type in the PNG file or bytes.size() if there is no such chunk
+std::size_t FindChunk(const std::vector<uint8_t> &bytes, const char *type_code) {
+    std::size_t offset = 8;
+    while (offset + 8 <= bytes.size()) {
+        if (std::memcmp(bytes.data() + offset + 4, type_code, 4) == 0) {
+            return offset;
+        }
+        offset += 12 + GetChunkDataLength(bytes, offset);
+    }
+    return bytes.size();
+}
+
+// flips a bit of the Adler-32 at the end of the only IDAT chunk, keeping its CRC valid
+std::vector<uint8_t> CorruptAdler32(std::vector<uint8_t> bytes) {
+    std::size_t offset = FindChunk(bytes, "IDAT");
+    if (offset == bytes.size()) {
+        return bytes;
+    }
+    uint32_t length = GetChunkDataLength(bytes, offset);
+    bytes[offset + 8 + length - 1] ^= 1;
+    CrcCalculator crc_calculator;
+    crc_calculator.add_bytes(reinterpret_cast<char *>(bytes.data() + offset + 4), 4 + length);
+    uint32_t crc = crc_calculator.get_checksum();
+    for (int byte = 0; byte < 4; byte++) {
+        bytes[offset + 8 + length + byte] = static_cast<uint8_t>(crc >> (24 - 8 * byte));
+    }
+    return bytes;
+}
+
+void CheckDecodeOptions() {
+    std::cerr << "Running decode options\n";
+    auto ok_image = libpng::ReadImage(kBasePath + "tests/logo.png");
+
+    // crc.png is logo.png with invalid CRC of the ancillary pHYs chunk
+    CHECK_THROWS(ReadPng(kBasePath + "tests/crc.png"));
+    for (CrcCheckMode mode: {CrcCheckMode::CRITICAL_ONLY, CrcCheckMode::NONE}) {
+        std::vector<uint8_t> bytes = ReadFileBytes("crc.png");
+        PNGDecoder decoder(std::span<const uint8_t>(bytes), {.crc_check_mode = mode});
+        Compare(decoder.build_image(), ok_image);
+        // IHDR, gAMA, cHRM, bKGD, pHYs, tIME, IDAT, 3 tEXt, IEND
+        if (mode == CrcCheckMode::CRITICAL_ONLY) {
+            REQUIRE(decoder.get_counters().checked_crc_count == 3);
+            REQUIRE(decoder.get_counters().skipped_crc_count == 8);
+        } else {
+            REQUIRE(decoder.get_counters().checked_crc_count == 0);
+            REQUIRE(decoder.get_counters().skipped_crc_count == 11);
+        }
+        REQUIRE(decoder.get_counters().skipped_adler32_count == 0);
+    }
+
+    std::vector<uint8_t> bytes = CorruptAdler32(ReadFileBytes("logo.png"));
+    CHECK_THROWS(PNGDecoder(std::span<const uint8_t>(bytes)));
+    PNGDecoder decoder(std::span<const uint8_t>(bytes), {.need_to_check_adler32 = false});
+    Compare(decoder.build_image(), ok_image);
+    REQUIRE(decoder.get_counters().skipped_adler32_count == 1);
+    REQUIRE(decoder.get_counters().skipped_crc_count == 0);
+}
+
+// a PNG file of the given chunks with valid CRCs
+std::vector<uint8_t> MakePng(const std::vector<std::pair<std::string, std::string>> &chunks) {
+    std::vector<uint8_t> bytes = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    auto append_uint32 = [&](uint32_t value) {
+        for (int byte = 0; byte < 4; byte++) {
+            bytes.push_back(static_cast<uint8_t>(value >> (24 - 8 * byte)));
+        }
+    };
+    for (const auto &[type_code, data]: chunks) {
+        append_uint32(data.size());
+        std::string type_and_data = type_code + data;
+        bytes.insert(bytes.end(), type_and_data.begin(), type_and_data.end());
+        CrcCalculator crc_calculator;
+        crc_calculator.add_bytes(type_and_data.data(), type_and_data.size());
+        append_uint32(crc_calculator.get_checksum());
+    }
+    return bytes;
+}
+
+// signature, IHDR of 1x1 RGBA image and the header of a chunk of data_length bytes without its data,
+// a tiny file that declares a huge chunk
+std::vector<uint8_t> MakeLongChunkPng(const std::string &type_code, uint32_t data_length) {
+    std::string ihdr = {0, 0, 0, 1, 0, 0, 0, 1, 8, 6, 0, 0, 0};
+    std::vector<uint8_t> bytes = MakePng({{"IHDR", ihdr}});
+    for (int byte = 0; byte < 4; byte++) {
+        bytes.push_back(static_cast<uint8_t>(data_length >> (24 - 8 * byte)));
+    }
+    bytes.insert(bytes.end(), type_code.begin(), type_code.end());
+    return bytes;
+}
+
+void CheckProbe(const std::string &filename) {
+    std::cerr << "Running probe " << filename << '\n';
+    std::vector<uint8_t> bytes = ReadFileBytes(filename);
+    IHDR ihdr = PNGDecoder(std::span<const uint8_t>(bytes)).get_ihdr();
+    for (bool need_to_scan_chunks: {false, true}) {
+        for (const ProbeResult &probe: {ProbePng(kBasePath + "tests/" + filename, need_to_scan_chunks),
+                                        ProbePng(std::span<const uint8_t>(bytes), need_to_scan_chunks)}) {
+            REQUIRE(std::memcmp(&probe.ihdr, &ihdr, sizeof(IHDR)) == 0);
+            REQUIRE(probe.has_palette == (need_to_scan_chunks && ihdr.color_type == 3));
+            REQUIRE(!probe.is_animated);
+        }
+    }
+
+    // only the signature, IHDR and the chunks before IDAT are needed
+    std::size_t offset = FindChunk(bytes, "IDAT");
+    REQUIRE(ProbePng(std::span<const uint8_t>(bytes.data(), 8 + 25)).ihdr.width == ihdr.width);
+    REQUIRE(ProbePng(std::span<const uint8_t>(bytes.data(), offset + 8), true).ihdr.height == ihdr.height);
+    CHECK_THROWS_AS(ProbePng(std::span<const uint8_t>(bytes.data(), 8 + 24)), FailedToReadException);
+}
+
+// chunks of huge declared length before IDAT are skipped in small parts, not allocated
+void CheckProbeLongChunks() {
+    std::cerr << "Running probe long chunks\n";
+    std::vector<uint8_t> bytes = MakeLongChunkPng("tEXt", 0x7fffffff);
+
+    std::string filename = (std::filesystem::temp_directory_path() / "png_decoder_probe_long_chunk.png").string();
+    {
+        std::ofstream output(filename, std::ios_base::out | std::ios_base::binary);
+        REQUIRE(output.is_open());
+        output.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    }
+    CHECK(ProbePng(filename).ihdr.width == 1);
+    CHECK_THROWS_AS(ProbePng(filename, true), FailedToReadException);
+    CHECK_THROWS_AS(ProbePng(std::span<const uint8_t>(bytes), true), FailedToReadException);
+    std::filesystem::remove(filename);
+
+    // PLTE, tRNS and acTL longer than their maximum length
+    std::string ihdr = {0, 0, 0, 1, 0, 0, 0, 1, 8, 3, 0, 0, 0};
+    for (const auto &[type_code, data_length]: {std::pair<std::string, std::size_t>{"PLTE", 3 * 257},
+                                                {"tRNS", 257},
+                                                {"acTL", 9}}) {
+        std::vector<uint8_t> long_chunk = MakePng({{"IHDR", ihdr}, {type_code, std::string(data_length, 0)}});
+        CHECK_THROWS_AS(ProbePng(std::span<const uint8_t>(long_chunk), true), InvalidPNGFormatException);
+    }
+    std::vector<uint8_t> long_ihdr = MakePng({{"IHDR", ihdr + '\0'}});
+    CHECK_THROWS_AS(ProbePng(std::span<const uint8_t>(long_ihdr)), InvalidPNGFormatException);
+}
+
+struct PassRows {
+    std::size_t height;
+    std::size_t row_len_in_bytes;// without the filter type byte
+};
+
+// the passes that are stored in the image data: the whole image or the non-empty Adam7 passes
+std::vector<PassRows> GetPassRows(IHDR ihdr) {
+    std::vector<PassRows> passes;
+    int first_pass_cnt = ihdr.interlace_method == 0 ? 0 : 1;
+    int last_pass_cnt = ihdr.interlace_method == 0 ? 0 : 7;
+    for (int pass_cnt = first_pass_cnt; pass_cnt <= last_pass_cnt; pass_cnt++) {
+        auto [height, width] = get_subimage_shape_in_interlace(pass_cnt, ihdr.height, ihdr.width);
+        if (height != 0 && width != 0) {
+            passes.push_back({height, (ihdr.get_pixel_len_in_bits() * width + 7) / 8});
+        }
+    }
+    return passes;
+}
+
+void CheckDecodeCost(const std::string &filename) {
+    std::cerr << "Running decode cost " << filename << '\n';
+    std::vector<uint8_t> bytes = ReadFileBytes(filename);
+    PNGDecoder decoder{std::span<const uint8_t>(bytes)};
+    IHDR ihdr = decoder.get_ihdr();
+    DecodeCost cost = decoder.get_decode_cost();
+
+    std::size_t row_count = 0;
+    std::size_t row_bytes = 0;
+    for (const PassRows &pass: GetPassRows(ihdr)) {
+        row_count += pass.height;
+        row_bytes += pass.height * pass.row_len_in_bytes;
+    }
+    std::size_t counted_rows = 0;
+    std::size_t counted_bytes = 0;
+    for (std::size_t filter_type = 0; filter_type < 5; filter_type++) {
+        counted_rows += cost.filter_type_counts[filter_type];
+        counted_bytes += cost.filter_type_bytes[filter_type];
+    }
+    REQUIRE(counted_rows == row_count);
+    REQUIRE(counted_bytes == row_bytes);
+    REQUIRE(cost.pixel_count == static_cast<std::size_t>(ihdr.width) * ihdr.height);
+    REQUIRE(cost.predicted_ns > 0);
+
+    // the filter type bytes stay after unfiltering
+    decoder.build_image();
+    DecodeCost cost_after = decoder.get_decode_cost();
+    REQUIRE(cost_after.filter_type_counts == cost.filter_type_counts);
+    REQUIRE(cost_after.predicted_ns == cost.predicted_ns);
+}
+
+#ifdef PNG_DECODER_STATS
+void CheckDecodeStats(const std::string &filename, ThreadPool *pool = nullptr) {
+    std::cerr << "Running decode stats " << filename << '\n';
+    std::vector<uint8_t> bytes = ReadFileBytes(filename);
+    DecoderContext context;
+    for (int round = 0; round < 2; round++) {
+        PNGDecoder decoder(std::span<const uint8_t>(bytes), context, {.thread_pool = pool});
+        Image image = decoder.build_image();
+        IHDR ihdr = decoder.get_ihdr();
+        const DecodeStats &stats = decoder.get_stats();
+
+        // some files have bytes after IEND
+        REQUIRE(stats.input_bytes <= bytes.size());
+        REQUIRE(stats.idat_chunk_count >= 1);
+        REQUIRE(stats.chunk_count >= stats.idat_chunk_count + 2);
+        REQUIRE(stats.compressed_bytes < stats.input_bytes);
+        REQUIRE(stats.output_bytes == 4 * ihdr.width * ihdr.height);
+        REQUIRE(stats.inflate_ns > 0);
+        // CRC of every chunk is checked by default
+        REQUIRE(stats.crc_ns > 0);
+        REQUIRE(stats.crc_ns <= stats.read_chunks_ns);
+        REQUIRE(stats.write_pixels_ns > 0);
+
+        std::size_t row_count = 0;
+        std::size_t decompressed_bytes = 0;
+        for (const PassRows &pass: GetPassRows(ihdr)) {
+            row_count += pass.height;
+            // each row starts with a filter type byte
+            decompressed_bytes += pass.height * (pass.row_len_in_bytes + 1);
+        }
+        std::size_t filtered_row_count = 0;
+        for (std::size_t count: stats.filter_type_counts) {
+            filtered_row_count += count;
+        }
+        REQUIRE(filtered_row_count == row_count);
+        REQUIRE(stats.decompressed_bytes == decompressed_bytes);
+
+        // the buffers of the context have grown in the first round
+        if (round == 1) {
+            REQUIRE(stats.buffer_allocation_count == 0);
+        }
+    }
+
+    PNGDecoder decoder(std::span<const uint8_t>(bytes), {.crc_check_mode = CrcCheckMode::NONE});
+    REQUIRE(decoder.get_stats().crc_ns == 0);
+}
+#endif
+
+// reads all rows through PNGRowReader, returns the row count
+std::size_t ReadRowsWithLimits(const std::string &filename, DecodeLimits limits) {
+    std::ifstream input(kBasePath + "tests/" + filename, std::ios_base::in | std::ios_base::binary);
+    REQUIRE(input.is_open());
+    PNGRowReader reader(input, limits);
+    std::vector<uint8_t> row_data(reader.get_row_size());
+    std::size_t row_count = 0;
+    while (reader.next_row(row_data)) {
+        row_count++;
+    }
+    return row_count;
+}
+
+void CheckDecodeLimits() {
+    std::cerr << "Running decode limits\n";
+    auto ok_image = libpng::ReadImage(kBasePath + "tests/logo.png");
+    std::vector<uint8_t> bytes = ReadFileBytes("logo.png");
+    std::span<const uint8_t> data(bytes);
+    IHDR ihdr = PNGDecoder(data).get_ihdr();
+    DecodeCounters counters = PNGDecoder(data).get_counters();
+    std::size_t chunk_count = counters.checked_crc_count;
+
+    // exactly at the limits
+    DecodeLimits limits{.max_pixels = static_cast<std::uint64_t>(ihdr.width) * ihdr.height,
+                        .max_decompressed_bytes = get_pixels_data_size(ihdr),
+                        .max_chunk_size = bytes.size(),
+                        .max_chunk_count = chunk_count,
+                        .max_ancillary_bytes = bytes.size()};
+    Compare(PNGDecoder(data, {.limits = limits}).build_image(), ok_image);
+    Compare(ReadPng(kBasePath + "tests/logo.png", {.limits = limits}), ok_image);
+    REQUIRE(ReadRowsWithLimits("logo.png", limits) == static_cast<std::size_t>(ok_image.Height()));
+    Compare(ReadPngStreaming(kBasePath + "tests/logo.png", limits), ok_image);
+
+    for (int limit = 0; limit < 6; limit++) {
+        DecodeLimits bad_limits = limits;
+        if (limit == 0) {
+            bad_limits.max_pixels--;
+        } else if (limit == 1) {
+            bad_limits.max_decompressed_bytes--;
+        } else if (limit == 2) {
+            bad_limits.max_chunk_size = 100;
+        } else if (limit == 3) {
+            bad_limits.max_chunk_count--;
+        } else if (limit == 4) {
+            bad_limits.max_ancillary_bytes = 10;
+        } else {
+            bad_limits.deadline = std::chrono::steady_clock::now();
+        }
+        CHECK_THROWS_AS(PNGDecoder(data, {.limits = bad_limits}), DecodeLimitException);
+        std::ifstream input(kBasePath + "tests/logo.png", std::ios_base::in | std::ios_base::binary);
+        REQUIRE(input.is_open());
+        CHECK_THROWS_AS(PNGDecoder(input, {.limits = bad_limits}), DecodeLimitException);
+        CHECK_THROWS_AS(ReadRowsWithLimits("logo.png", bad_limits), DecodeLimitException);
+        CHECK_THROWS_AS(ReadPngStreaming(kBasePath + "tests/logo.png", bad_limits), DecodeLimitException);
+    }
+
+    // 2^30 x 2^30 pixels in 57 bytes, rejected before allocating
+    std::string huge_ihdr = {0x40, 0, 0, 0, 0x40, 0, 0, 0, 8, 6, 0, 0, 0};
+    std::vector<uint8_t> huge = MakePng({{"IHDR", huge_ihdr}, {"IDAT", "x"}, {"IEND", ""}});
+    CHECK_THROWS_AS(PNGDecoder(std::span<const uint8_t>(huge), {.limits = {.max_pixels = 100'000'000}}),
+                    DecodeLimitException);
+    CHECK_THROWS_AS(PNGDecoder(std::span<const uint8_t>(huge), {.limits = {.max_decompressed_bytes = 1 << 30}}),
+                    DecodeLimitException);
+
+    // a chunk of 2^31 - 1 bytes in a stream, rejected before reading it
+    std::vector<uint8_t> long_chunk = MakeLongChunkPng("tEXt", 0x7fffffff);
+    std::istringstream long_chunk_input(std::string(long_chunk.begin(), long_chunk.end()));
+    CHECK_THROWS_AS(PNGDecoder(long_chunk_input, {.limits = {.max_chunk_size = 1 << 20}}), DecodeLimitException);
+    long_chunk_input.clear();
+    long_chunk_input.seekg(0);
+    CHECK_THROWS_AS(PNGRowReader(long_chunk_input, {.max_chunk_size = 1 << 20}), DecodeLimitException);
+
+    // chunks of 2^31 - 1 bytes in 41 bytes without limits, the data grows only as it arrives
+    for (const std::string type_code: {"tEXt", "IDAT", "PLTE"}) {
+        std::vector<uint8_t> long_file = MakeLongChunkPng(type_code, 0x7fffffff);
+        std::istringstream long_file_input(std::string(long_file.begin(), long_file.end()));
+        if (type_code == "PLTE") {
+            CHECK_THROWS_AS(PNGDecoder(long_file_input), InvalidPNGFormatException);
+        } else {
+            CHECK_THROWS_AS(PNGDecoder(long_file_input), FailedToReadException);
+        }
+        CHECK_THROWS_AS(PNGDecoder(std::span<const uint8_t>(long_file)), PNGDecoderException);
+    }
+
+    ThreadPool pool(2);
+    auto inter_image = libpng::ReadImage(kBasePath + "tests/inter.png");
+    Compare(ReadPng(kBasePath + "tests/inter.png", {.thread_pool = &pool, .limits = {.max_pixels = 1 << 30}}),
+            inter_image);
+}
+
+void CheckThreadPool(std::size_t thread_count) {
+    std::cerr << "Running thread pool " << thread_count << "\n";
+    ThreadPool pool(thread_count);
+    REQUIRE(pool.get_thread_count() == thread_count);
+
+    // every index exactly once, also for nested calls from the tasks
+    const std::size_t kOuterCount = 50;
+    const std::size_t kInnerCount = 100;
+    std::vector<std::atomic<int>> visits(kOuterCount * kInnerCount);
+    pool.parallel_for(kOuterCount, [&](std::size_t outer) {
+        pool.parallel_for(kInnerCount, [&](std::size_t inner) {
+            visits[outer * kInnerCount + inner]++;
+        });
+    });
+    for (const auto &visit: visits) {
+        REQUIRE(visit == 1);
+    }
+
+    std::atomic<std::size_t> finished_count = 0;
+    CHECK_THROWS_AS(pool.parallel_for(kOuterCount, [&](std::size_t index) {
+        finished_count++;
+        if (index == 7) {
+            throw std::runtime_error("task failed");
+        }
+    }), std::runtime_error);
+    REQUIRE(finished_count == kOuterCount);
+}
+
+void CheckDecodeBatch(const std::vector<std::string> &filenames) {
+    std::cerr << "Running decode batch\n";
+    std::vector<std::string> paths;
+    for (const auto &filename: filenames) {
+        paths.push_back(kBasePath + "tests/" + filename);
+    }
+    paths.push_back(kBasePath + "tests/crc.png");
+    paths.push_back(kBasePath + "tests/not_found.png");
+
+    ThreadPool pool(4);
+    std::vector<DecodeResult> results = DecodeBatch(paths, pool);
+    REQUIRE(results.size() == paths.size());
+    for (std::size_t index = 0; index < filenames.size(); index++) {
+        REQUIRE(!results[index].error);
+        Compare(results[index].image, libpng::ReadImage(paths[index]));
+    }
+    REQUIRE(results[filenames.size()].error);
+    REQUIRE(results[filenames.size() + 1].error);
+    CHECK_THROWS_AS(std::rethrow_exception(results.back().error), PNGDecoderException);
+
+    std::vector<std::atomic<int>> callback_counts(paths.size());
+    DecodeBatch(paths, pool, [&](std::size_t index, DecodeResult &&result) {
+        callback_counts[index] += result.error ? 2 : 1;
+    });
+    for (std::size_t index = 0; index < paths.size(); index++) {
+        REQUIRE(callback_counts[index] == (index < filenames.size() ? 1 : 2));
+    }
+
+    REQUIRE(DecodeBatch(std::span<const std::string>(), 2).empty());
+}
+
+void CheckImageStreaming(const std::string &filename) {
+    std::cerr << "Running streaming " << filename << "\n";
+    auto image = ReadPngStreaming(kBasePath + "tests/" + filename);
+    auto ok_image = libpng::ReadImage(kBasePath + "tests/" + filename);
+    Compare(image, ok_image);
+}
+
+void CheckDecodeInto(const std::string &filename, PixelFormat format, ThreadPool *pool = nullptr) {
+    std::cerr << "Running decode_into " << filename << "\n";
+    std::ifstream input(kBasePath + "tests/" + filename, std::ios_base::in | std::ios_base::binary);
+    REQUIRE(input.is_open());
+    PNGDecoder decoder(input, {.thread_pool = pool});
+    auto ok_image = libpng::ReadImage(kBasePath + "tests/" + filename);
+    REQUIRE(decoder.get_ihdr().width == static_cast<uint32_t>(ok_image.Width()));
+    REQUIRE(decoder.get_ihdr().height == static_cast<uint32_t>(ok_image.Height()));
+
+    // padded rows, the padding must stay untouched
+    const uint8_t kPadding = 0xcd;
+    std::size_t pixel_size = get_pixel_size(format);
+    std::size_t stride = pixel_size * ok_image.Width() + 5;
+    std::vector<uint8_t> buffer(stride * ok_image.Height(), kPadding);
+    decoder.decode_into(buffer.data(), stride, format);
+
+    for (int y = 0; y < ok_image.Height(); ++y) {
+        const uint8_t *row = buffer.data() + y * stride;
+        for (int x = 0; x < ok_image.Width(); ++x) {
+            const uint8_t *pixel = row + x * pixel_size;
+            RGB actual_data;
+            switch (format) {
+                case PixelFormat::RGBA8:
+                    actual_data = {pixel[0], pixel[1], pixel[2], pixel[3]};
+                    break;
+                case PixelFormat::BGRA8:
+                    actual_data = {pixel[2], pixel[1], pixel[0], pixel[3]};
+                    break;
+                case PixelFormat::RGB8:
+                    actual_data = {pixel[0], pixel[1], pixel[2], ok_image(y, x).a};
+                    break;
+                default:
+                    FAIL("16-bit formats are checked by CheckDecodeInto16");
+            }
+            REQUIRE(actual_data == ok_image(y, x));
+        }
+        for (std::size_t i = pixel_size * ok_image.Width(); i < stride; ++i) {
+            REQUIRE(row[i] == kPadding);
+        }
+    }
+}
+
+void CheckDecodeInto16(const std::string &filename, PixelFormat format, ThreadPool *pool = nullptr) {
+    std::cerr << "Running decode_into 16 bits " << filename << "\n";
+    auto ok_image = libpng::ReadImage<RGB16>(kBasePath + "tests/" + filename);
+    const uint8_t kPadding = 0xcd;
+    std::size_t pixel_size = get_pixel_size(format);
+    // odd padding makes the rows unaligned for RGB16
+    for (std::size_t padding: {5, 6}) {
+        std::vector<uint8_t> bytes = ReadFileBytes(filename);
+        PNGDecoder decoder(std::span<const uint8_t>(bytes), {.thread_pool = pool});
+        std::size_t stride = pixel_size * ok_image.Width() + padding;
+        std::vector<uint8_t> buffer(stride * ok_image.Height(), kPadding);
+        decoder.decode_into(buffer.data(), stride, format);
+
+        for (int y = 0; y < ok_image.Height(); ++y) {
+            const uint8_t *row = buffer.data() + y * stride;
+            for (int x = 0; x < ok_image.Width(); ++x) {
+                RGB16 actual_data;
+                if (format == PixelFormat::RGBA16) {
+                    std::memcpy(&actual_data, row + x * pixel_size, sizeof(RGB16));
+                } else {
+                    std::memcpy(&actual_data.r, row + x * pixel_size, 2);
+                    actual_data.g = actual_data.b = actual_data.r;
+                    actual_data.a = ok_image(y, x).a;
+                }
+                REQUIRE(actual_data == ok_image(y, x));
+            }
+            for (std::size_t i = pixel_size * ok_image.Width(); i < stride; ++i) {
+                REQUIRE(row[i] == kPadding);
+            }
+        }
+    }
+}
+
+void CheckImage16(const std::string &filename) {
+    auto ok_image = libpng::ReadImage<RGB16>(kBasePath + "tests/" + filename);
+    auto image = ReadPng16(kBasePath + "tests/" + filename);
+    REQUIRE(image.Height() == ok_image.Height());
+    REQUIRE(image.Width() == ok_image.Width());
+    for (int y = 0; y < image.Height(); ++y) {
+        for (int x = 0; x < image.Width(); ++x) {
+            REQUIRE(image(y, x) == ok_image(y, x));
+        }
+    }
+}
+
+// reads all rows of reader and compares them with the image
+void CompareRows(PNGRowReader &reader, const Image &ok_image) {
+    std::vector<uint8_t> row_data(reader.get_row_size());
+    int y = 0;
+    while (reader.next_row(row_data)) {
+        REQUIRE(y < ok_image.Height());
+        for (int x = 0; x < ok_image.Width(); ++x) {
+            RGB actual_data{row_data[4 * x], row_data[4 * x + 1], row_data[4 * x + 2], row_data[4 * x + 3]};
+            REQUIRE(actual_data == ok_image(y, x));
+        }
+        ++y;
+    }
+    REQUIRE(y == ok_image.Height());
+}
+
+void CheckRowReader(const std::string &filename) {
+    std::cerr << "Running row reader " << filename << "\n";
+    std::ifstream input(kBasePath + "tests/" + filename, std::ios_base::in | std::ios_base::binary);
+    REQUIRE(input.is_open());
+    PNGRowReader reader(input);
+    auto ok_image = libpng::ReadImage(kBasePath + "tests/" + filename);
+    REQUIRE(reader.get_ihdr().width == static_cast<uint32_t>(ok_image.Width()));
+    REQUIRE(reader.get_ihdr().height == static_cast<uint32_t>(ok_image.Height()));
+
+    CompareRows(reader, ok_image);
+}
+
+// the streaming reader keeps only IHDR and PLTE, other chunks are skipped without buffering
+void CheckStreamingChunks() {
+    std::cerr << "Running streaming chunks\n";
+    auto ok_image = libpng::ReadImage(kBasePath + "tests/logo.png");
+    std::vector<uint8_t> bytes = ReadFileBytes("logo.png");
+    // 8 bytes of signature and 25 bytes of IHDR
+    std::vector<uint8_t> text_chunk = MakePng({{"tEXt", std::string(1 << 20, 'x')}});
+    bytes.insert(bytes.begin() + 33, text_chunk.begin() + 8, text_chunk.end());
+    std::istringstream input(std::string(bytes.begin(), bytes.end()));
+    PNGRowReader reader(input);
+    CompareRows(reader, ok_image);
+
+    // a chunk of 2^31 - 1 bytes in 41 bytes, fails on reading instead of allocating
+    std::vector<uint8_t> long_chunk = MakeLongChunkPng("tEXt", 0x7fffffff);
+    std::istringstream long_chunk_input(std::string(long_chunk.begin(), long_chunk.end()));
+    CHECK_THROWS_AS(PNGRowReader(long_chunk_input), FailedToReadException);
+
+    // palette of more than 256 entries
+    std::string ihdr = {0, 0, 0, 1, 0, 0, 0, 1, 8, 6, 0, 0, 0};
+    std::vector<uint8_t> long_palette = MakePng({{"IHDR", ihdr}, {"PLTE", std::string(3 * 257, 0)}});
+    std::istringstream long_palette_input(std::string(long_palette.begin(), long_palette.end()));
+    CHECK_THROWS_AS(PNGRowReader(long_palette_input), InvalidPNGFormatException);
+}
+
+// straightforward filter removal from the PNG specification
+void ReferenceRemoveFilter(uint8_t *scanline, const uint8_t *previous_scanline, std::size_t row_len_in_bytes, std::size_t bpp) {
+    uint8_t *data = scanline + 1;
+    for (std::size_t byte = 0; byte < row_len_in_bytes; byte++) {
+        int a = byte >= bpp ? data[byte - bpp] : 0;
+        int b = previous_scanline != nullptr ? previous_scanline[byte + 1] : 0;
+        int c = byte >= bpp && previous_scanline != nullptr ? previous_scanline[byte + 1 - bpp] : 0;
+        int predictor = 0;
+        if (*scanline == 1) {
+            predictor = a;
+        } else if (*scanline == 2) {
+            predictor = b;
+        } else if (*scanline == 3) {
+            predictor = (a + b) / 2;
+        } else if (*scanline == 4) {
+            int p = a + b - c;
+            int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+            predictor = pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+        }
+        data[byte] += predictor;
+    }
+}
+
+void CheckFilter(uint8_t filter_type) {
+    std::mt19937 rnd(filter_type);
+    for (std::size_t bpp: {1, 2, 3, 4, 6, 8}) {
+        for (std::size_t width: {1, 2, 3, 5, 7, 16, 33, 100}) {
+            std::size_t row_len_in_bytes = width * bpp;
+            std::vector<uint8_t> previous(row_len_in_bytes + 1), actual(row_len_in_bytes + 1);
+            for (auto &byte: previous) {
+                byte = rnd();
+            }
+            for (auto &byte: actual) {
+                byte = rnd();
+            }
+            actual[0] = filter_type;
+            for (bool is_first_row: {true, false}) {
+                const uint8_t *previous_scanline = is_first_row ? nullptr : previous.data();
+                auto expected = actual;
+                ReferenceRemoveFilter(expected.data(), previous_scanline, row_len_in_bytes, bpp);
+                auto result = actual;
+                remove_filter(result.data(), previous_scanline, row_len_in_bytes, bpp);
+                REQUIRE(result == expected);
+            }
+        }
+    }
+}
+
+// segments bounded by None/Sub rows unfiltered on the pool must give the sequential result
+void CheckParallelFilters() {
+    std::mt19937 rnd(42);
+    const std::size_t kRowLen = 3000;
+    const std::size_t kHeight = 1000;
+    std::vector<uint8_t> data((kRowLen + 1) * kHeight);
+    for (auto &byte: data) {
+        byte = rnd();
+    }
+    for (std::size_t row = 0; row < kHeight; row++) {
+        // mostly dependent rows with rare None/Sub ones
+        data[row * (kRowLen + 1)] = rnd() % 10 == 0 ? rnd() % 2 : 2 + rnd() % 3;
+    }
+
+    std::vector<std::size_t> starts = split_into_independent_segments(data.data(), kRowLen, kHeight, 1 << 16);
+    REQUIRE(starts.size() > 1);
+    REQUIRE(starts[0] == 0);
+    for (std::size_t i = 1; i < starts.size(); i++) {
+        REQUIRE(starts[i - 1] < starts[i]);
+        REQUIRE(data[starts[i] * (kRowLen + 1)] <= 1);
+        REQUIRE((starts[i] - starts[i - 1]) * (kRowLen + 1) >= (1 << 16));
+    }
+
+    auto expected = data;
+    remove_filters(expected.data(), 24, kRowLen, kHeight);
+    ThreadPool pool(4);
+    remove_filters_parallel(data.data(), 24, kRowLen, kHeight, pool);
+    REQUIRE(data == expected);
+}
+
+void CheckImageThreadPool(const std::string &filename, ThreadPool &pool) {
+    std::cerr << "Running with thread pool " << filename << "\n";
+    auto image = ReadPng(kBasePath + "tests/" + filename, {.thread_pool = &pool});
+    auto ok_image = libpng::ReadImage(kBasePath + "tests/" + filename);
+    Compare(image, ok_image);
+}
+
+// specialized unpacking must match reading every pixel by BitReader
+// compares the specialized loops with read_pixel, for RGB16 also with the 8-bit pixels
+template <typename Pixel = RGB>
+void CheckUnpacker(uint8_t color_type, uint8_t bit_depth) {
+    std::mt19937 rnd(color_type * 100 + bit_depth);
+    IHDR ihdr{};
+    ihdr.color_type = color_type;
+    ihdr.bit_depth = bit_depth;
+    std::string palette(3 * 256, '\0');
+    for (auto &byte: palette) {
+        byte = static_cast<char>(rnd());
+    }
+    BasicPixelUnpacker<Pixel> unpacker(ihdr, palette);
+
+    for (std::size_t width: {1, 2, 3, 7, 8, 9, 33}) {
+        std::vector<uint8_t> data((ihdr.get_pixel_len_in_bits() * width + 7) / 8);
+        for (auto &byte: data) {
+            byte = rnd();
+        }
+        std::vector<Pixel> actual(width);
+        unpacker.unpack(data.data(), width, actual.data());
+
+        BitReader bit_reader(data.data());
+        BitReader bit_reader8(data.data());
+        for (std::size_t column = 0; column < width; column++) {
+            Pixel expected = read_pixel<Pixel>(ihdr, bit_reader, palette);
+            REQUIRE(actual[column] == expected);
+            if constexpr (std::is_same_v<Pixel, RGB16>) {
+                RGB pixel8 = read_pixel(ihdr, bit_reader8, palette);
+                if (bit_depth <= 8) {
+                    // both scalings are exact
+                    REQUIRE(expected == RGB16{static_cast<uint16_t>(pixel8.r * 257), static_cast<uint16_t>(pixel8.g * 257),
+                                              static_cast<uint16_t>(pixel8.b * 257), static_cast<uint16_t>(pixel8.a * 257)});
+                } else {
+                    // the 8-bit value is rounded down from the same sample
+                    REQUIRE(pixel8.r == (expected.r >> 8) - ((expected.r & 0xff) < (expected.r >> 8)));
+                }
+            }
+        }
+    }
+}